@@ -1,9 +1,422 @@
 #include "Buffer.h"
+#include "BufferSearch.h"
 
 #include <errno.h>
+#include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+namespace
+{
+
+// 线程退出的时候内存池已经析构了 之后再释放的块直接delete
+__thread bool t_chunkPoolDestroyed = false;
+
+// 分块模式用的内存池 每个线程一个，块在哪个线程释放就回到哪个线程的池里
+class ChunkPool
+{
+public:
+    static const size_t kMaxPooledChunks = 256; // 每个线程最多缓存4MB
+
+    ~ChunkPool()
+    {
+        for (char *chunk : free_)
+        {
+            delete[] chunk;
+        }
+        t_chunkPoolDestroyed = true;
+    }
+
+    char* get()
+    {
+        if (free_.empty())
+        {
+            return new char[Buffer::kChunkSize];
+        }
+        char *chunk = free_.back();
+        free_.pop_back();
+        return chunk;
+    }
+
+    void put(char *chunk)
+    {
+        if (free_.size() < kMaxPooledChunks)
+        {
+            free_.push_back(chunk);
+        }
+        else
+        {
+            delete[] chunk;
+        }
+    }
+
+private:
+    std::vector<char*> free_;
+};
+
+thread_local ChunkPool t_chunkPool;
+
+// 数据超过一块的时候(拼接peek、一次写入很大)单独分配 不进内存池
+char* allocChunkData(size_t capacity)
+{
+    if (capacity == Buffer::kChunkSize && !t_chunkPoolDestroyed)
+    {
+        return t_chunkPool.get();
+    }
+    return new char[capacity];
+}
+
+void freeChunkData(char *data, size_t capacity)
+{
+    if (capacity == Buffer::kChunkSize && !t_chunkPoolDestroyed)
+    {
+        t_chunkPool.put(data);
+    }
+    else
+    {
+        delete[] data;
+    }
+}
+
+const char kEmpty[1] = {0};
+
+// readFd的溢出区 线程局部存储只在线程创建的时候清零一次
+__thread char t_readScratch[Buffer::kReadScratchSize];
+
+}
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kChunkSize;
+const size_t Buffer::kReadScratchSize;
+const size_t Buffer::kMinReadTarget;
+const size_t Buffer::kMaxReadTarget;
+const size_t Buffer::npos;
+
+Buffer::~Buffer()
+{
+    releaseChunks();
+}
+
+Buffer::Buffer(const Buffer &rhs)
+    : buffer_(rhs.buffer_)
+    , readerIndex_(rhs.readerIndex_)
+    , writerIndex_(rhs.writerIndex_)
+    , chunked_(rhs.chunked_)
+    , chunkedBytes_(0)
+    , readTarget_(rhs.readTarget_)
+    , readStats_(rhs.readStats_)
+{
+    for (const Chunk &chunk : rhs.chunks_)
+    {
+        appendChunked(chunk.data + chunk.readIndex, chunk.writeIndex - chunk.readIndex);
+    }
+}
+
+Buffer& Buffer::operator=(Buffer rhs)
+{
+    swap(rhs);
+    return *this;
+}
+
+void Buffer::swap(Buffer &rhs)
+{
+    swapData(rhs);
+    std::swap(readTarget_, rhs.readTarget_);
+    std::swap(readStats_, rhs.readStats_);
+}
+
+void Buffer::swapData(Buffer &rhs)
+{
+    buffer_.swap(rhs.buffer_);
+    std::swap(readerIndex_, rhs.readerIndex_);
+    std::swap(writerIndex_, rhs.writerIndex_);
+    std::swap(chunked_, rhs.chunked_);
+    chunks_.swap(rhs.chunks_);
+    std::swap(chunkedBytes_, rhs.chunkedBytes_);
+}
+
+void Buffer::adoptStorage(std::vector<char> *storage)
+{
+    if (writerIndex_ != readerIndex_ || storage->size() <= kCheapPrepend)
+    {
+        return;
+    }
+    buffer_.swap(*storage);
+    readerIndex_ = writerIndex_ = kCheapPrepend;
+}
+
+bool Buffer::releaseStorage(std::vector<char> *storage)
+{
+    // 分块模式的数据在块里 连续部分总是空的
+    if (writerIndex_ != readerIndex_)
+    {
+        return false;
+    }
+    storage->clear();
+    storage->swap(buffer_);
+    readerIndex_ = writerIndex_ = kCheapPrepend;
+    return true;
+}
+
+size_t Buffer::storageBytes() const
+{
+    size_t bytes = buffer_.size();
+    for (const Chunk &chunk : chunks_)
+    {
+        bytes += chunk.capacity;
+    }
+    return bytes;
+}
+
+void Buffer::shrink(size_t reserve)
+{
+    if (chunked_)
+    {
+        return;
+    }
+    size_t readable = readableBytes();
+    std::vector<char> buf(kCheapPrepend + readable + reserve);
+    std::copy(begin() + readerIndex_, begin() + writerIndex_, buf.begin() + kCheapPrepend);
+    buffer_.swap(buf);
+    readerIndex_ = kCheapPrepend;
+    writerIndex_ = kCheapPrepend + readable;
+}
+
+void Buffer::setChunked(bool on)
+{
+    if (on == chunked_)
+    {
+        return;
+    }
+    if (on)
+    {
+        appendChunked(begin() + readerIndex_, writerIndex_ - readerIndex_);
+        // 连续模式的内存不再需要 切回去的时候重新分配
+        std::vector<char>().swap(buffer_);
+        readerIndex_ = writerIndex_ = kCheapPrepend;
+        chunked_ = true;
+    }
+    else
+    {
+        std::vector<char> buf(kCheapPrepend + std::max(chunkedBytes_, kInitialSize));
+        size_t offset = kCheapPrepend;
+        for (const Chunk &chunk : chunks_)
+        {
+            memcpy(&buf[offset], chunk.data + chunk.readIndex, chunk.writeIndex - chunk.readIndex);
+            offset += chunk.writeIndex - chunk.readIndex;
+        }
+        buffer_.swap(buf);
+        readerIndex_ = kCheapPrepend;
+        writerIndex_ = offset;
+        releaseChunks();
+        chunked_ = false;
+    }
+}
+
+size_t Buffer::findByte(char c, size_t from) const
+{
+    const size_t readable = readableBytes();
+    if (from >= readable)
+    {
+        return npos;
+    }
+    const char *start = peek();
+    const char *found = BufferSearch::findByte(start + from, start + readable, c);
+    return found ? found - start : npos;
+}
+
+size_t Buffer::find(const char *delim, size_t len, size_t from) const
+{
+    const size_t readable = readableBytes();
+    if (from > readable || readable - from < len)
+    {
+        return npos;
+    }
+    const char *start = peek();
+    const char *found = BufferSearch::find(start + from, start + readable, delim, len);
+    return found ? found - start : npos;
+}
+
+void Buffer::peekBytes(void *dst, size_t len) const
+{
+    if (!chunked_)
+    {
+        memcpy(dst, begin() + readerIndex_, len);
+        return;
+    }
+    char *out = static_cast<char*>(dst);
+    for (const Chunk &chunk : chunks_)
+    {
+        if (len == 0)
+        {
+            break;
+        }
+        size_t m = std::min(len, chunk.writeIndex - chunk.readIndex);
+        memcpy(out, chunk.data + chunk.readIndex, m);
+        out += m;
+        len -= m;
+    }
+}
+
+void Buffer::prepend(const void *data, size_t len)
+{
+    const char *d = static_cast<const char*>(data);
+    if (!chunked_)
+    {
+        if (!hasStorage())
+        {
+            buffer_.resize(kCheapPrepend + kInitialSize); // 预留区也在底层存储里
+        }
+        if (len > prependableBytes())
+        {
+            // 预留区放不下 把可读数据往后挪，挪完前面除了这次的len还留kCheapPrepend
+            size_t readable = readableBytes();
+            size_t newReaderIndex = len + kCheapPrepend;
+            if (newReaderIndex + readable > buffer_.size())
+            {
+                buffer_.resize(newReaderIndex + readable);
+            }
+            std::copy_backward(begin() + readerIndex_, begin() + writerIndex_, begin() + newReaderIndex + readable);
+            readerIndex_ = newReaderIndex;
+            writerIndex_ = newReaderIndex + readable;
+        }
+        readerIndex_ -= len;
+        std::copy(d, d + len, begin() + readerIndex_);
+        return;
+    }
+    if (chunks_.empty() || chunks_.front().readIndex < len)
+    {
+        // 新块的数据放在末尾 后面还可以接着往前放
+        Chunk chunk;
+        chunk.capacity = std::max(len, kChunkSize);
+        chunk.data = allocChunkData(chunk.capacity);
+        chunk.readIndex = chunk.writeIndex = chunk.capacity;
+        chunks_.push_front(chunk);
+    }
+    Chunk &front = chunks_.front();
+    front.readIndex -= len;
+    memcpy(front.data + front.readIndex, d, len);
+    chunkedBytes_ += len;
+}
+
+void Buffer::addChunk(size_t minCapacity)
+{
+    // 最后一块是空的(比如刚读完) 换成一个够大的块 不在链表中间留空块
+    if (!chunks_.empty() && chunks_.back().readIndex == chunks_.back().writeIndex)
+    {
+        freeChunkData(chunks_.back().data, chunks_.back().capacity);
+        chunks_.pop_back();
+    }
+    Chunk chunk;
+    chunk.capacity = std::max(minCapacity, kChunkSize);
+    chunk.data = allocChunkData(chunk.capacity);
+    chunk.readIndex = chunk.writeIndex = 0;
+    chunks_.push_back(chunk);
+}
+
+void Buffer::popFrontChunk() const
+{
+    freeChunkData(chunks_.front().data, chunks_.front().capacity);
+    chunks_.pop_front();
+}
+
+void Buffer::releaseChunks()
+{
+    while (!chunks_.empty())
+    {
+        popFrontChunk();
+    }
+    chunkedBytes_ = 0;
+}
+
+const char* Buffer::chunkedPeek() const
+{
+    if (chunkedBytes_ == 0)
+    {
+        return chunks_.empty() ? kEmpty : chunks_.front().data + chunks_.front().readIndex;
+    }
+    const Chunk &front = chunks_.front();
+    if (front.writeIndex - front.readIndex == chunkedBytes_)
+    {
+        return front.data + front.readIndex; // 数据都在第一块里
+    }
+
+    // 跨了多个块 拼成一整块 之后的append接在它后面的新块里
+    Chunk merged;
+    merged.capacity = std::max(chunkedBytes_, kChunkSize);
+    merged.data = allocChunkData(merged.capacity);
+    merged.readIndex = 0;
+    merged.writeIndex = 0;
+    while (!chunks_.empty())
+    {
+        const Chunk &chunk = chunks_.front();
+        memcpy(merged.data + merged.writeIndex, chunk.data + chunk.readIndex, chunk.writeIndex - chunk.readIndex);
+        merged.writeIndex += chunk.writeIndex - chunk.readIndex;
+        popFrontChunk();
+    }
+    chunks_.push_back(merged);
+    return merged.data;
+}
+
+void Buffer::retrieveChunked(size_t len)
+{
+    if (len >= chunkedBytes_)
+    {
+        releaseChunks();
+        return;
+    }
+    chunkedBytes_ -= len;
+    while (len > 0)
+    {
+        Chunk &front = chunks_.front();
+        size_t n = front.writeIndex - front.readIndex;
+        if (len < n)
+        {
+            front.readIndex += len;
+            break;
+        }
+        len -= n;
+        popFrontChunk(); // 整块读完 还给内存池
+    }
+}
+
+std::string Buffer::retrieveChunkedAsString(size_t len)
+{
+    len = std::min(len, chunkedBytes_);
+    std::string result;
+    result.reserve(len);
+    for (const Chunk &chunk : chunks_)
+    {
+        if (result.size() == len)
+        {
+            break;
+        }
+        size_t n = std::min(len - result.size(), chunk.writeIndex - chunk.readIndex);
+        result.append(chunk.data + chunk.readIndex, n);
+    }
+    retrieveChunked(len);
+    return result;
+}
+
+void Buffer::appendChunked(const char *data, size_t len)
+{
+    chunkedBytes_ += len;
+    while (len > 0)
+    {
+        if (chunks_.empty() || chunks_.back().writeIndex == chunks_.back().capacity)
+        {
+            addChunk(kChunkSize);
+        }
+        Chunk &back = chunks_.back();
+        size_t n = std::min(len, back.capacity - back.writeIndex);
+        memcpy(back.data + back.writeIndex, data, n);
+        back.writeIndex += n;
+        data += n;
+        len -= n;
+    }
+}
+
 /**
  * 从fd上读取数据 Poller工作在LT模式下
  * Buffer缓冲区是有大小的，但是从fd上读取数据的时候，却不知道tcp数据最终的大小
@@ -12,7 +425,19 @@
 
 ssize_t Buffer::readFd(int fd, int *savedErrno)
 {
-    char extrabuf[65536] = {0}; // 栈上的内存空间 64k
+    if (chunked_)
+    {
+        return readFdChunked(fd, savedErrno);
+    }
+    // 最近读得多的连接先把缓冲区扩到readTarget_，数据直接读进缓冲区，不用再从scratch拷一次
+    // 小消息的连接readTarget_会缩回去，缓冲区保持很小，偶尔的大包由scratch接住
+    // 存储还回BufferPool以后(或者Buffer(0))没有底层存储 也要先分配，不然writerIndex_会退到readerIndex_前面
+    if (!hasStorage() || (readTarget_ > kInitialSize && writableBytes() < readTarget_))
+    {
+        ensureWritableBytes(readTarget_);
+    }
+    // 每个线程一块 不初始化 以前每次读都要把栈上的64k清零
+    char *extrabuf = t_readScratch;
 
     struct iovec vec[2];
 
@@ -21,10 +446,10 @@ ssize_t Buffer::readFd(int fd, int *savedErrno)
     vec[0].iov_len = writable;
 
     vec[1].iov_base = extrabuf;
-    vec[1].iov_len = sizeof extrabuf;
+    vec[1].iov_len = kReadScratchSize;
   // when there is enough space in this buffer, don't read into extrabuf.
   // when extrabuf is used, we read 128k-1 bytes at most.
-    const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1; // 两个缓冲区都有空间，就使用两个缓冲区，否则只使用一个缓冲区 当writable 大于 extrabuf时，把数据读入extrabuf意义不大，因为extrabuf只有64k
+    const int iovcnt = (writable < kReadScratchSize) ? 2 : 1; // 两个缓冲区都有空间，就使用两个缓冲区，否则只使用一个缓冲区 当writable 大于 extrabuf时，把数据读入extrabuf意义不大，因为extrabuf只有64k
   // when extrabuf is used, we read 128k-1 bytes at most.
     const ssize_t n = ::readv(fd, vec, iovcnt);
 
@@ -38,18 +463,154 @@ ssize_t Buffer::readFd(int fd, int *savedErrno)
     }
     else // extrabuf里面也写入了数据 
     {
-        writerIndex_ = buffer_.size();
+        writerIndex_ += writable;
         append(extrabuf, n - writable); // writerIndex_ 开始写n - writeable大小的数据
+        readStats_.scratchBytes += n - writable;
+    }
+    if (n >= 0)
+    {
+        adjustReadTarget(n);
     }
     return n;
 }
 
+// 这次读满了readTarget_就加倍 连续读得很少就减半
+void Buffer::adjustReadTarget(size_t n)
+{
+    ++readStats_.calls;
+    readStats_.bytes += n;
+    if (n >= readTarget_)
+    {
+        readTarget_ = std::min(readTarget_ * 2, kMaxReadTarget);
+    }
+    else if (n < readTarget_ / 4)
+    {
+        readTarget_ = std::max(readTarget_ / 2, kMinReadTarget);
+    }
+}
+
 ssize_t Buffer::writeFd(int fd, int *savedErrno)
 {
+    if (chunked_)
+    {
+        return writeFdChunked(fd, savedErrno);
+    }
     ssize_t n = ::write(fd, peek(), readableBytes());
     if (n < 0)
     {
         *savedErrno = errno;
     }
     return n;
-}
\ No newline at end of file
+}
+/**
+ * 分块模式下直接读进块里 最后一块剩下的空间加上几个新块一起交给readv，
+ * 没有用上的新块还给内存池，不需要extrabuf再拷一次
+*/
+ssize_t Buffer::readFdChunked(int fd, int *savedErrno)
+{
+    static const int kMaxReadChunks = static_cast<int>(kMaxReadTarget / kChunkSize);
+    struct iovec vec[kMaxReadChunks + 1];
+    Chunk fresh[kMaxReadChunks];
+    int iovcnt = 0;
+
+    const size_t tail = writableBytes();
+    // 按readTarget_决定这次拿几个新块 至少一个
+    const int readChunks = static_cast<int>(std::min<size_t>(kMaxReadChunks,
+        std::max<size_t>(1, (std::max(readTarget_, tail) - tail + kChunkSize - 1) / kChunkSize)));
+    if (tail > 0)
+    {
+        vec[iovcnt].iov_base = chunks_.back().data + chunks_.back().writeIndex;
+        vec[iovcnt].iov_len = tail;
+        ++iovcnt;
+    }
+    for (int i = 0; i < readChunks; ++i)
+    {
+        fresh[i].capacity = kChunkSize;
+        fresh[i].data = allocChunkData(kChunkSize);
+        fresh[i].readIndex = fresh[i].writeIndex = 0;
+        vec[iovcnt].iov_base = fresh[i].data;
+        vec[iovcnt].iov_len = kChunkSize;
+        ++iovcnt;
+    }
+
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    size_t left = n > 0 ? static_cast<size_t>(n) : 0;
+    if (n < 0)
+    {
+        *savedErrno = errno;
+    }
+    else
+    {
+        chunkedBytes_ += n;
+        adjustReadTarget(n);
+        if (tail > 0)
+        {
+            size_t m = std::min(left, tail);
+            chunks_.back().writeIndex += m;
+            left -= m;
+        }
+    }
+    for (int i = 0; i < readChunks; ++i)
+    {
+        if (left > 0)
+        {
+            fresh[i].writeIndex = std::min(left, kChunkSize);
+            left -= fresh[i].writeIndex;
+            chunks_.push_back(fresh[i]);
+        }
+        else
+        {
+            freeChunkData(fresh[i].data, fresh[i].capacity);
+        }
+    }
+    return n;
+}
+
+// 一次writev把前面的块都交给内核 发出去多少由调用方retrieve
+ssize_t Buffer::writeFdChunked(int fd, int *savedErrno)
+{
+    static const int kMaxWriteChunks = 64;
+    struct iovec vec[kMaxWriteChunks];
+    int iovcnt = readableIovecs(0, chunkedBytes_, vec, kMaxWriteChunks);
+    ssize_t n = ::writev(fd, vec, iovcnt);
+    if (n < 0)
+    {
+        *savedErrno = errno;
+    }
+    return n;
+}
+
+int Buffer::readableIovecs(size_t offset, size_t len, struct iovec *vec, int maxIov) const
+{
+    if (len == 0 || maxIov <= 0)
+    {
+        return 0;
+    }
+    if (!chunked_)
+    {
+        vec[0].iov_base = const_cast<char*>(peek()) + offset;
+        vec[0].iov_len = len;
+        return 1;
+    }
+    int iovcnt = 0;
+    for (const Chunk &chunk : chunks_)
+    {
+        if (iovcnt == maxIov || len == 0)
+        {
+            break;
+        }
+        size_t bytes = chunk.writeIndex - chunk.readIndex;
+        if (offset >= bytes)
+        {
+            offset -= bytes;
+            continue;
+        }
+        size_t m = std::min(bytes - offset, len);
+        vec[iovcnt].iov_base = chunk.data + chunk.readIndex + offset;
+        vec[iovcnt].iov_len = m;
+        ++iovcnt;
+        len -= m;
+        offset = 0;
+    }
+    return iovcnt;
+}
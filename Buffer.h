@@ -2,9 +2,16 @@
 
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <algorithm>
 
+#include <stdint.h>
+#include <endian.h>
+#include <sys/types.h>
+
+struct iovec;
+
 
 //网络底层的缓冲器类型定义
 /// A buffer class modeled simulate org.jboss.netty.buffer.ChannelBuffer
@@ -18,45 +25,108 @@
 /// 0      <=      readerIndex   <=   writerIndex    <=     size
 /// @endcode
 ///非阻塞编程中，buffer还是非常必要的，无论是读写，因为tcp的缓冲区是有限的，又因为是非阻塞的，（即陆续发送完）所以需要自己维护一个buffer，这样才能保证数据的完整性
+///
+///分块模式(setChunked)：数据存在一串固定大小的块里，块来自每个线程自己的内存池。
+///append只往最后一块后面写，不会搬移已有的数据；retrieve读完一整块就把块还给内存池；
+///readFd/writeFd直接对块链表做readv/writev。peek()需要连续内存的时候才把数据拷成一整块，
+///所以积压了几MB的输出缓冲区适合用分块模式，按消息解析的输入缓冲区还是用连续模式
 class Buffer 
 
 {
 public:
     static const size_t kCheapPrepend = 8;
     static const size_t kInitialSize = 1024;
+    static const size_t kChunkSize = 16 * 1024;
+    static const size_t kReadScratchSize = 64 * 1024;
+    // readFd每次希望读到的字节数 根据最近几次读到的多少在这个范围里自适应
+    static const size_t kMinReadTarget = 1024;
+    static const size_t kMaxReadTarget = 64 * 1024;
+
+    // readv的统计 calls/bytes可以算出每次调用读到多少 scratchBytes是先落到scratch再拷进来的字节
+    struct ReadStats
+    {
+        ReadStats() : calls(0), bytes(0), scratchBytes(0) {}
+        int64_t calls;
+        int64_t bytes;
+        int64_t scratchBytes;
+    };
 
 // 即使没有inline，编译器也会自动将其作为inline构造函数
+    // initialSize为0的时候先不分配 第一次写入或者adoptStorage的时候才有底层存储
     explicit Buffer(size_t initialSize = kInitialSize)
-        : buffer_(kCheapPrepend + initialSize)
+        : buffer_(initialSize > 0 ? kCheapPrepend + initialSize : 0)
         , readerIndex_(kCheapPrepend)
         , writerIndex_(kCheapPrepend)
+        , chunked_(false)
+        , chunkedBytes_(0)
+        , readTarget_(kMinReadTarget)
         {}
 
+    ~Buffer();
+    Buffer(const Buffer &rhs);
+    Buffer& operator=(Buffer rhs);
+    void swap(Buffer &rhs);
+    // 只交换数据和底层存储 读取的调优状态(readTarget_、readStats_)各自留着
+    // 把一个连接的inputBuffer_整个交给send的时候用，不会把两边的读统计搅在一起
+    void swapData(Buffer &rhs);
+
+    // 连续模式的底层存储 可以从BufferPool借来、没有数据的时候还回去
+    bool hasStorage() const {return !buffer_.empty();}
+    // 换上外面给的存储 缓冲区里不能有数据 storage换成原来的存储(可能是空的)
+    void adoptStorage(std::vector<char> *storage);
+    // 没有数据的时候把存储交出去 之后再写入会重新分配，有数据的时候返回false
+    bool releaseStorage(std::vector<char> *storage);
+    // 底层占用的内存 连续模式是vector的大小 分块模式是所有块的容量
+    size_t storageBytes() const;
+    // 把连续模式的存储缩小到正好放下现有数据再加reserve字节 突发流量把缓冲区撑大以后用来还内存
+    // 分块模式读完的块已经还掉了 不需要缩
+    void shrink(size_t reserve);
+
+    // 切换连续/分块模式 缓冲区里的数据会原样保留
+    void setChunked(bool on);
+    bool chunked() const {return chunked_;}
+
     size_t readableBytes() const 
     {
-        return writerIndex_ - readerIndex_;
+        return chunked_ ? chunkedBytes_ : writerIndex_ - readerIndex_;
     }
 
     size_t writableBytes() const
     {
-        return buffer_.size() - writerIndex_;
+        if (chunked_)
+        {
+            return chunks_.empty() ? 0 : chunks_.back().capacity - chunks_.back().writeIndex;
+        }
+        return buffer_.size() > writerIndex_ ? buffer_.size() - writerIndex_ : 0; // 没有底层存储的时候为0
     }
 
     size_t prependableBytes() const
     {
+        if (chunked_)
+        {
+            return chunks_.empty() ? 0 : chunks_.front().readIndex;
+        }
         return readerIndex_;
     }
 
-    //返回可读数据的起始位置
+    //返回可读数据的起始位置 分块模式下数据跨了多个块的时候先拼成一整块
     const char* peek() const
     {
+        if (chunked_)
+        {
+            return chunkedPeek();
+        }
         return begin() + readerIndex_;
     }
 
     // onMessage string <- Buffer
     void retrieve(size_t len) // retrieve 更像是一个移动指针的操作
     {
-        if (len < readableBytes())
+        if (chunked_)
+        {
+            retrieveChunked(len);
+        }
+        else if (len < readableBytes())
         {
             readerIndex_ += len; //应用只读取了刻度缓冲区的一部分数据，就是len，还剩下readerIndex_ += len -> writerIndex_的数据
         }
@@ -67,6 +137,11 @@ public:
 
     void retrieveAll()
     {
+        if (chunked_)
+        {
+            releaseChunks();
+            return;
+        }
         readerIndex_ = writerIndex_ = kCheapPrepend;
 
     }
@@ -78,6 +153,10 @@ public:
     }
     std::string retrieveAsString(size_t len)
     {
+        if (chunked_)
+        {
+            return retrieveChunkedAsString(len); // 逐块拷贝 不需要先拼成连续内存
+        }
         std::string result(peek(), len);
         retrieve(len); //上面一句把缓冲区可读的数据已经读取出来，这里肯定要对缓冲区进行复位操作 也就是更新
         return result;
@@ -88,7 +167,14 @@ public:
     {
         if (writableBytes() < len)
         {
-            makeSpace(len); // 扩容函数
+            if (chunked_)
+            {
+                addChunk(len); // 挂一个新块 已有的数据不动
+            }
+            else
+            {
+                makeSpace(len); // 扩容函数
+            }
         }
     }
 
@@ -97,27 +183,196 @@ public:
     // 无论是从fd上读取数据 或者把数据写入buffer中，都需要写入writable对应的缓冲区
     void append(const char* data, size_t len)
     {
+        if (chunked_)
+        {
+            appendChunked(data, len);
+            return;
+        }
         ensureWritableBytes(len);
         std::copy(data, data + len, beginWrite());
         writerIndex_ += len;
     }
 
+    void append(const void* data, size_t len)
+    {
+        append(static_cast<const char*>(data), len);
+    }
+
+    // 整数按网络字节序(大端)写入/读出 peek和read之前要确认readableBytes()够长
+    void appendInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        append(&be64, sizeof be64);
+    }
+
+    void appendInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        append(&be32, sizeof be32);
+    }
+
+    void appendInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        append(&be16, sizeof be16);
+    }
+
+    void appendInt8(int8_t x)
+    {
+        append(&x, sizeof x);
+    }
+
+    int64_t peekInt64() const
+    {
+        int64_t be64 = 0;
+        peekBytes(&be64, sizeof be64);
+        return be64toh(be64);
+    }
+
+    int32_t peekInt32() const
+    {
+        int32_t be32 = 0;
+        peekBytes(&be32, sizeof be32);
+        return be32toh(be32);
+    }
+
+    int16_t peekInt16() const
+    {
+        int16_t be16 = 0;
+        peekBytes(&be16, sizeof be16);
+        return be16toh(be16);
+    }
+
+    int8_t peekInt8() const
+    {
+        int8_t x = 0;
+        peekBytes(&x, sizeof x);
+        return x;
+    }
+
+    int64_t readInt64()
+    {
+        int64_t result = peekInt64();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int32_t readInt32()
+    {
+        int32_t result = peekInt32();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int16_t readInt16()
+    {
+        int16_t result = peekInt16();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    int8_t readInt8()
+    {
+        int8_t result = peekInt8();
+        retrieve(sizeof result);
+        return result;
+    }
+
+    // 把数据放到可读数据的前面 用的是kCheapPrepend预留的空间，给已经写好的消息加长度头不需要搬移消息本身
+    // 连续模式下超过prependableBytes()的时候要把可读数据往后挪(必要时扩容) 分块模式前面放不下的时候在链表头部加一块
+    void prepend(const void *data, size_t len);
+
+    void prependInt64(int64_t x)
+    {
+        int64_t be64 = htobe64(x);
+        prepend(&be64, sizeof be64);
+    }
+
+    void prependInt32(int32_t x)
+    {
+        int32_t be32 = htobe32(x);
+        prepend(&be32, sizeof be32);
+    }
+
+    void prependInt16(int16_t x)
+    {
+        int16_t be16 = htobe16(x);
+        prepend(&be16, sizeof be16);
+    }
+
+    void prependInt8(int8_t x)
+    {
+        prepend(&x, sizeof x);
+    }
+
     char* beginWrite()
     {
+        if (chunked_)
+        {
+            return chunks_.back().data + chunks_.back().writeIndex;
+        }
         return begin() + writerIndex_;
     }
 
     const char* beginWrite() const
     {
+        if (chunked_)
+        {
+            return chunks_.back().data + chunks_.back().writeIndex;
+        }
         return begin() + writerIndex_;
     }
 
+    static const size_t npos = static_cast<size_t>(-1);
+
+    // 在可读数据里查找分隔符 返回相对peek()的偏移，找不到返回npos 用的是BufferSearch的向量化扫描
+    // from是开始查找的偏移：行还没收完的时候记下已经扫过的长度，下次readFd以后从那里接着扫，
+    // 多字节分隔符可能被拆在两次读之间，没找到的时候下次从resumeFrom(len)开始
+    // 分块模式下会先把数据拼成连续内存 按行解析的输入缓冲区应该用连续模式
+    size_t findByte(char c, size_t from = 0) const;
+    size_t find(const char *delim, size_t len, size_t from = 0) const;
+    size_t findCRLF(size_t from = 0) const {return find("\r\n", 2, from);}
+    size_t findEOL(size_t from = 0) const {return findByte('\n', from);}
+    // 长度为delimLen的分隔符没找到以后 下一次查找的起点 可读数据比delimLen - 1还少的时候从0开始
+    size_t resumeFrom(size_t delimLen) const
+    {
+        size_t readable = readableBytes();
+        return delimLen > 0 && readable >= delimLen - 1 ? readable - (delimLen - 1) : 0;
+    }
+
     // 从fd上读取数据
     ssize_t readFd(int fd, int* savedErrno);
+    const ReadStats& readStats() const {return readStats_;}
+    size_t readTarget() const {return readTarget_;}
     // 通过fd发送数据
     ssize_t writeFd(int fd, int* savedErrno);
+    // 把可读数据里[offset, offset+len)这一段填进vec，最多maxIov个，返回用掉的个数
+    // 给外面拼writev用 分块模式下不需要先拼成连续内存
+    int readableIovecs(size_t offset, size_t len, struct iovec *vec, int maxIov) const;
 
 private:
+    // 分块模式下的一块 容量是kChunkSize的块来自线程的内存池，拼接peek()或者一次写入超过kChunkSize的时候用单独分配的大块
+    struct Chunk
+    {
+        char *data;
+        size_t capacity;
+        size_t readIndex;
+        size_t writeIndex;
+    };
+    using ChunkList = std::deque<Chunk>;
+
+    // 从可读数据开头拷len个字节出来 分块模式下不用为了几个字节把整个缓冲区拼成连续内存
+    void peekBytes(void *dst, size_t len) const;
+    void addChunk(size_t minCapacity);
+    void popFrontChunk() const;
+    void releaseChunks();
+    const char* chunkedPeek() const;
+    void retrieveChunked(size_t len);
+    std::string retrieveChunkedAsString(size_t len);
+    void appendChunked(const char *data, size_t len);
+    ssize_t readFdChunked(int fd, int *savedErrno);
+    void adjustReadTarget(size_t n);
+    ssize_t writeFdChunked(int fd, int *savedErrno);
 
     /**
      * buffer_.begin(): This line calls the begin() function of std::vector<char>. This function returns an iterator pointing to the first element in the vector.
@@ -127,13 +382,14 @@ operator is used to obtain the address of the first element. This effectively gi
     */
     char* begin()
     {
-        return &*buffer_.begin(); // vector底层数组首元素的地址，也就是buffer_的首地址，因为vector的begin()返回的是一个迭代器，而不是指针，所以需要加上&*，才能得到指针
+        // vector底层数组首元素的地址，也就是buffer_的首地址。没有底层存储的时候vector是空的，&*buffer_.begin()会解引用end()，所以用data()
+        return buffer_.data();
     }
 
 // 常量版本，当对象是const时，调用此版本，当是非const时，调用上面的版本
     const char* begin() const
     {
-        return &*buffer_.begin();
+        return buffer_.data();
     }
 
     void makeSpace(size_t len)
@@ -155,4 +411,12 @@ operator is used to obtain the address of the first element. This effectively gi
     size_t readerIndex_;
     size_t writerIndex_;
 
+    bool chunked_;
+    // peek()是const的 拼接的时候要替换块链表
+    mutable ChunkList chunks_;
+    size_t chunkedBytes_;
+
+    size_t readTarget_;
+    ReadStats readStats_;
+
 };
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "BufferPool.h"
+#include "EventLoop.h"
+
+#include <algorithm>
+#include <functional>
+
+// 池子里的存储超过这么久没被借走就释放
+static const double kTrimIntervalSeconds = 10.0;
+
+const size_t BufferPool::kMinClassSize;
+const size_t BufferPool::kMaxClassSize;
+const size_t BufferPool::kDefaultMaxPooledBytes;
+
+BufferPool::BufferPool(EventLoop *loop, size_t maxPooledBytes)
+    : loop_(loop)
+    , maxPooledBytes_(maxPooledBytes)
+    , classes_(classFor(kMaxClassSize) + 1)
+    , lowWater_(classes_.size(), 0)
+    , trimming_(false)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    if (trimming_)
+    {
+        loop_->cancel(trimTimer_);
+    }
+}
+
+int BufferPool::classFor(size_t size)
+{
+    if (size > kMaxClassSize)
+    {
+        return -1;
+    }
+    int cls = 0;
+    for (size_t classSize = kMinClassSize; classSize < size; classSize <<= 1)
+    {
+        ++cls;
+    }
+    return cls;
+}
+
+void BufferPool::acquire(size_t size, std::vector<char> *storage)
+{
+    ++stats_.acquires;
+    int cls = classFor(size);
+    // 这一级是空的 再往上找一级 大一点的也比重新分配好
+    for (int i = cls; i >= 0 && i < static_cast<int>(classes_.size()) && i <= cls + 1; ++i)
+    {
+        if (!classes_[i].empty())
+        {
+            storage->swap(classes_[i].back());
+            classes_[i].pop_back();
+            lowWater_[i] = std::min(lowWater_[i], classes_[i].size());
+            stats_.pooledBytes -= storage->size();
+            return;
+        }
+    }
+    ++stats_.allocations;
+    // 按级别的大小分配 还回来的时候正好落在同一级
+    std::vector<char>(cls >= 0 ? kMinClassSize << cls : size).swap(*storage);
+}
+
+void BufferPool::release(std::vector<char> *storage)
+{
+    ++stats_.releases;
+    size_t size = storage->size();
+    if (size < kMinClassSize || size > kMaxClassSize
+        || stats_.pooledBytes + size > maxPooledBytes_)
+    {
+        std::vector<char>().swap(*storage);
+        return;
+    }
+    // 向下取整 保证这一级里的vector都不小于级别的大小
+    int cls = classFor(size);
+    if ((kMinClassSize << cls) > size)
+    {
+        --cls;
+    }
+    stats_.pooledBytes += size;
+    classes_[cls].push_back(std::vector<char>());
+    classes_[cls].back().swap(*storage);
+
+    if (!trimming_)
+    {
+        // 和TimingWheel一样 池子空了定时器就停掉
+        trimming_ = true;
+        trimTimer_ = loop_->runEvery(kTrimIntervalSeconds, std::bind(&BufferPool::trim, this));
+    }
+}
+
+void BufferPool::trim()
+{
+    for (size_t i = 0; i < classes_.size(); ++i)
+    {
+        std::vector<std::vector<char>> &free = classes_[i];
+        // 先借出去的是末尾的 开头的lowWater_个整段时间都没动过
+        size_t idle = std::min(lowWater_[i], free.size());
+        for (size_t j = 0; j < idle; ++j)
+        {
+            stats_.pooledBytes -= free[j].size();
+        }
+        free.erase(free.begin(), free.begin() + idle);
+        lowWater_[i] = free.size();
+    }
+
+    if (stats_.pooledBytes == 0 && trimming_)
+    {
+        trimming_ = false;
+        loop_->cancel(trimTimer_);
+    }
+}
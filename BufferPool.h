@@ -0,0 +1,62 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TimerId.h"
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+class EventLoop;
+
+/**
+ * 每个EventLoop一个的Buffer存储池 连接的输入/输出缓冲区从这里借底层的vector，用完还回来
+ *
+ * 连接频繁建立断开的时候，每个连接两个Buffer的分配、扩容、释放都是malloc/free，扩容得到的容量也随着连接一起丢掉了。
+ * 池子按2的幂分级(1KB ~ 1MB)，还回来的vector按它的大小向下取整放进对应的级别，扩容过的大vector下次还能被需要大缓冲区的连接用上；
+ * 连接只在真的有数据要存的时候才借，缓冲区空了就还，空闲连接不占缓冲区内存
+ *
+ * 超过最大级别的vector和超过总量上限的部分直接释放
+ * 池子里有存储的时候每隔一段时间检查一次，整段时间里一直没被借走的存储释放掉，突发过后池子会慢慢缩回去
+ * 所有接口都只能在loop线程中调用
+*/
+class BufferPool : noncopyable
+{
+public:
+    static const size_t kMinClassSize = 1024;
+    static const size_t kMaxClassSize = 1024 * 1024;
+    static const size_t kDefaultMaxPooledBytes = 16 * 1024 * 1024;
+
+    struct Stats
+    {
+        Stats() : acquires(0), allocations(0), releases(0), pooledBytes(0) {}
+        int64_t acquires;
+        int64_t allocations; // acquire时池子里没有 新分配的次数
+        int64_t releases;
+        int64_t pooledBytes; // 池子里现在缓存的字节数
+    };
+
+    explicit BufferPool(EventLoop *loop, size_t maxPooledBytes = kDefaultMaxPooledBytes);
+    ~BufferPool();
+
+    // 借一个size()不小于size的vector 内容不要依赖：池子里复用的是上一个使用者留下的数据，新分配的是清零的
+    void acquire(size_t size, std::vector<char> *storage);
+    // 还回来 storage变成空的
+    void release(std::vector<char> *storage);
+
+    const Stats& stats() const {return stats_;}
+
+private:
+    // 能放下size字节的最小级别 超过最大级别返回-1
+    static int classFor(size_t size);
+    // 释放上一次检查以后一直空闲的存储
+    void trim();
+
+    EventLoop *loop_;
+    const size_t maxPooledBytes_;
+    std::vector<std::vector<std::vector<char>>> classes_;
+    std::vector<size_t> lowWater_; // 每一级从上次检查到现在最少剩下几个 这么多个一直没人用
+    Stats stats_;
+    bool trimming_;
+    TimerId trimTimer_;
+};
@@ -0,0 +1,236 @@
+#include "BufferSearch.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BUFFERSEARCH_X86 1
+#endif
+
+namespace
+{
+
+const char* findByteScalar(const char *begin, const char *end, char c)
+{
+    return static_cast<const char*>(memchr(begin, c, end - begin));
+}
+
+const char* findScalar(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const char *last = end - len; // 最后一个可能的起点
+    const char *p = begin;
+    while (p <= last)
+    {
+        p = static_cast<const char*>(memchr(p, delim[0], last - p + 1));
+        if (p == nullptr)
+        {
+            return nullptr;
+        }
+        if (memcmp(p + 1, delim + 1, len - 1) == 0)
+        {
+            return p;
+        }
+        ++p;
+    }
+    return nullptr;
+}
+
+#ifdef BUFFERSEARCH_X86
+
+const char* findByteSse2(const char *begin, const char *end, char c)
+{
+    const __m128i target = _mm_set1_epi8(c);
+    const char *p = begin;
+    for (; p + 16 <= end; p += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, target));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return p < end ? findByteScalar(p, end, c) : nullptr;
+}
+
+// 候选起点i满足 p[i] == delim[0] && p[i + len - 1] == delim[len - 1]
+const char* findSse2(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const __m128i first = _mm_set1_epi8(delim[0]);
+    const __m128i last = _mm_set1_epi8(delim[len - 1]);
+    const char *lastStart = end - len;
+    const char *p = begin;
+    // 这一组16个起点的尾字节最远读到p + 15 + len - 1 <= end - 1
+    for (; p + 15 <= lastStart; p += 16)
+    {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+                                                        _mm_cmpeq_epi8(blockLast, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (len <= 2 || memcmp(p + bit + 1, delim + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return p <= lastStart ? findScalar(p, end, delim, len) : nullptr;
+}
+
+__attribute__((target("avx2")))
+const char* findByteAvx2(const char *begin, const char *end, char c)
+{
+    const __m256i target = _mm256_set1_epi8(c);
+    const char *p = begin;
+    // 一次比较64字节 两个掩码合起来只判断一次 命中了再分别找位置
+    for (; p + 64 <= end; p += 64)
+    {
+        __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), target);
+        __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32)), target);
+        if (!_mm256_testz_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq0, eq1)))
+        {
+            unsigned mask0 = _mm256_movemask_epi8(eq0);
+            if (mask0 != 0)
+            {
+                return p + __builtin_ctz(mask0);
+            }
+            return p + 32 + __builtin_ctz(static_cast<unsigned>(_mm256_movemask_epi8(eq1)));
+        }
+    }
+    for (; p + 32 <= end; p += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, target));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return p < end ? findByteSse2(p, end, c) : nullptr;
+}
+
+__attribute__((target("avx2")))
+const char* findAvx2(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const __m256i first = _mm256_set1_epi8(delim[0]);
+    const __m256i last = _mm256_set1_epi8(delim[len - 1]);
+    const char *lastStart = end - len;
+    const char *p = begin;
+    for (; p + 31 <= lastStart; p += 32)
+    {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + len - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+                                                              _mm256_cmpeq_epi8(blockLast, last)));
+        while (mask != 0)
+        {
+            int bit = __builtin_ctz(mask);
+            if (len <= 2 || memcmp(p + bit + 1, delim + 1, len - 2) == 0)
+            {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return p <= lastStart ? findSse2(p, end, delim, len) : nullptr;
+}
+
+BufferSearch::Level detectLevel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return BufferSearch::kAvx2;
+    }
+    return BufferSearch::kSse2; // x86_64的基线
+}
+
+#else
+
+BufferSearch::Level detectLevel()
+{
+    return BufferSearch::kScalar;
+}
+
+#endif
+
+const BufferSearch::Level g_bestLevel = detectLevel();
+
+} // namespace
+
+BufferSearch::Level BufferSearch::bestLevel()
+{
+    return g_bestLevel;
+}
+
+const char* BufferSearch::levelName(Level level)
+{
+    switch (level)
+    {
+    case kAvx2:
+        return "avx2";
+    case kSse2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+const char* BufferSearch::findByte(const char *begin, const char *end, char c)
+{
+    return findByte(begin, end, c, g_bestLevel);
+}
+
+const char* BufferSearch::find(const char *begin, const char *end, const char *delim, size_t len)
+{
+    return find(begin, end, delim, len, g_bestLevel);
+}
+
+const char* BufferSearch::findByte(const char *begin, const char *end, char c, Level level)
+{
+    if (begin >= end)
+    {
+        return nullptr;
+    }
+    switch (level)
+    {
+#ifdef BUFFERSEARCH_X86
+    case kAvx2:
+        return findByteAvx2(begin, end, c);
+    case kSse2:
+        return findByteSse2(begin, end, c);
+#endif
+    default:
+        return findByteScalar(begin, end, c);
+    }
+}
+
+const char* BufferSearch::find(const char *begin, const char *end, const char *delim, size_t len, Level level)
+{
+    if (len == 0)
+    {
+        return begin;
+    }
+    if (len == 1)
+    {
+        return findByte(begin, end, delim[0], level);
+    }
+    if (static_cast<size_t>(end - begin) < len)
+    {
+        return nullptr;
+    }
+    switch (level)
+    {
+#ifdef BUFFERSEARCH_X86
+    case kAvx2:
+        return findAvx2(begin, end, delim, len);
+    case kSse2:
+        return findSse2(begin, end, delim, len);
+#endif
+    default:
+        return findScalar(begin, end, delim, len);
+    }
+}
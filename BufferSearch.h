@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+/**
+ * Buffer里查找分隔符用的扫描函数 按CPU在运行时选择AVX2/SSE2/标量实现
+ *
+ * 多字节分隔符先用向量比较同时筛首字节和尾字节，两个都对上的位置才去比较中间部分，
+ * "\r\n"这种两个字节的分隔符筛出来的位置就是结果，不需要再比较
+ *
+ * 只有x86上有向量实现 其他平台都走标量(memchr/memcmp)
+*/
+namespace BufferSearch
+{
+    enum Level {kScalar, kSse2, kAvx2};
+
+    // 当前CPU支持的最高级别 程序启动的时候检测一次
+    Level bestLevel();
+    const char* levelName(Level level);
+
+    // 在[begin, end)里找第一个c 找不到返回nullptr
+    const char* findByte(const char *begin, const char *end, char c);
+    // 在[begin, end)里找第一个完整的delim 找不到返回nullptr
+    const char* find(const char *begin, const char *end, const char *delim, size_t len);
+
+    // 指定实现 性能测试用来对比各个级别 CPU不支持的级别不能传
+    const char* findByte(const char *begin, const char *end, char c, Level level);
+    const char* find(const char *begin, const char *end, const char *delim, size_t len, Level level);
+}
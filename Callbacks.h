@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <functional>
+#include <string>
 
 
 class Buffer;
@@ -16,6 +17,10 @@ using ConnectionCallback = std::function<void (const TcpConnectionPtr&)>;
 using CloseCallback = std::function<void (const TcpConnectionPtr&)>;
 using WriteCompleteCallback = std::function<void (const TcpConnectionPtr&)>;
 using HighWaterMarkCallback = std::function<void (const TcpConnectionPtr&, size_t)>;
+using TimerCallback = std::function<void ()>;
+
+// 应用自己持有的只读数据块 TcpConnection::send(block)只增加引用计数，发送完之前一直持有，不拷贝数据
+using BlockPtr = std::shared_ptr<const std::string>;
 
 // the data has been read to (buf, len)
 using MessageCallback = std::function<void (const TcpConnectionPtr&,
@@ -9,7 +9,7 @@ const int Channel::kReadEvent = EPOLLIN | EPOLLPRI;
 const int Channel::kWriteEvent = EPOLLOUT;
 
 Channel::Channel(EventLoop *loop, int fd_)
-    : loop_(loop), fd_(fd_), events_(0), revents_(0), index_(-1), tied_(false) // index是当前channel的状态 是否已经添加到epoll中
+    : loop_(loop), fd_(fd_), events_(0), revents_(0), index_(-1), tied_(false), edgeTriggered_(false), updateQueued_(false) // index是当前channel的状态 是否已经添加到epoll中
 {
 
 }
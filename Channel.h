@@ -48,6 +48,12 @@ class Channel : noncopyable
     void enableWriting() {events_ |= kWriteEvent; update();}
     void disableWriting() {events_ &= ~kWriteEvent; update();}
     void disableAll() {events_ = kNoneEvent; update();}
+    //一次同时注册读写事件 ET模式下注册一次以后就不用再反复修改写事件了
+    void enableReadingAndWriting() {events_ |= kReadEvent | kWriteEvent; update();}
+
+    //边沿触发 epoll只在fd状态变化的时候通知一次，回调必须一直读/写到EAGAIN
+    void setEdgeTriggered(bool on) {edgeTriggered_ = on; if (!isNoneEvent()) update();}
+    bool edgeTriggered() const {return edgeTriggered_;}
 
     //返回fd当前的事件状态
     bool isNoneEvent() const {return events_ == kNoneEvent;}
@@ -57,6 +63,10 @@ class Channel : noncopyable
     int index() {return index_;}
     void set_index(int idx) {index_ = idx;}
 
+    //EventLoop把一轮里的修改攒起来 poll之前一次性提交给poller 标记是否已经在待提交列表里
+    bool updateQueued() const {return updateQueued_;}
+    void setUpdateQueued(bool on) {updateQueued_ = on;}
+
     //one loop per thread
     EventLoop* ownerLoop() {return loop_;}
     void remove();
@@ -83,6 +93,8 @@ class Channel : noncopyable
     std::weak_ptr<void> tie_;
     
     bool tied_;
+    bool edgeTriggered_;
+    bool updateQueued_;
 
 // 因为channel通道里面能够获知fd最终发生的具体事件revents, 所以他负责调用具体事件的回调
     ReadEventCallback readCallback_;
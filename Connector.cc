@@ -0,0 +1,284 @@
+#include "Connector.h"
+#include "Channel.h"
+#include "EventLoop.h"
+#include "Logger.h"
+#include "Timestamp.h"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const double kDefaultInitRetryDelay = 0.5;
+static const double kDefaultMaxRetryDelay = 30.0;
+// 连接保持了这么久才算稳定 之后断开重连的间隔才从头开始，连上就被关掉的对端继续按退避的间隔重连
+static const double kStableConnectionSeconds = 5.0;
+
+static int createNonblocking()
+{
+    int sockfd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0)
+    {
+        LOG_FATAL("%s:%s:%d, connect socket create error:%d \n", __FILE__, __FUNCTION__, __LINE__, errno);
+    }
+    return sockfd;
+}
+
+// 非阻塞connect的结果要通过SO_ERROR取
+static int getSocketError(int sockfd)
+{
+    int optval = 0;
+    socklen_t optlen = sizeof optval;
+    if (::getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) < 0)
+    {
+        return errno;
+    }
+    return optval;
+}
+
+// 本地地址和对端地址完全一样就是自己连上了自己
+static bool isSelfConnect(int sockfd)
+{
+    sockaddr_in local;
+    sockaddr_in peer;
+    socklen_t localLen = sizeof local;
+    socklen_t peerLen = sizeof peer;
+    ::bzero(&local, sizeof local);
+    ::bzero(&peer, sizeof peer);
+    if (::getsockname(sockfd, (sockaddr*)&local, &localLen) < 0 ||
+        ::getpeername(sockfd, (sockaddr*)&peer, &peerLen) < 0)
+    {
+        return false;
+    }
+    return local.sin_port == peer.sin_port && local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+Connector::Connector(EventLoop *loop, const InetAddress &serverAddr)
+    : loop_(loop)
+    , serverAddr_(serverAddr)
+    , connect_(false)
+    , state_(kDisconnected)
+    , initRetryDelay_(kDefaultInitRetryDelay)
+    , maxRetryDelay_(kDefaultMaxRetryDelay)
+    , retryDelay_(kDefaultInitRetryDelay)
+    , retryPending_(false)
+    , random_(static_cast<unsigned>(Timestamp::monotonicNanos() ^ reinterpret_cast<uintptr_t>(this)))
+{
+}
+
+Connector::~Connector()
+{
+    if (channel_)
+    {
+        LOG_ERROR("Connector::~Connector %s - still connecting \n", serverAddr_.toIpPort().c_str());
+    }
+}
+
+void Connector::setRetryDelay(double initSeconds, double maxSeconds)
+{
+    if (initSeconds <= 0 || maxSeconds < initSeconds)
+    {
+        LOG_ERROR("Connector::setRetryDelay invalid delay init=%f max=%f \n", initSeconds, maxSeconds);
+        return;
+    }
+    initRetryDelay_ = initSeconds;
+    maxRetryDelay_ = maxSeconds;
+    retryDelay_ = initSeconds;
+}
+
+void Connector::start()
+{
+    connect_ = true;
+    loop_->runInLoop(std::bind(&Connector::startInLoop, shared_from_this()));
+}
+
+void Connector::restart()
+{
+    setState(kDisconnected);
+    connect_ = true;
+    if (timeDifference(Timestamp::now(), connectedTime_) >= kStableConnectionSeconds)
+    {
+        retryDelay_ = initRetryDelay_;
+    }
+    // 不马上连 和连接失败一样走带抖动的定时器，服务端重启的时候大量客户端不会在同一时刻重连
+    scheduleRetry();
+}
+
+void Connector::stop()
+{
+    connect_ = false;
+    loop_->queueInLoop(std::bind(&Connector::stopInLoop, shared_from_this()));
+}
+
+void Connector::startInLoop()
+{
+    retryPending_ = false;
+    if (state_ != kDisconnected)
+    {
+        return; // 已经在连了 比如stop之后马上又start
+    }
+    if (connect_)
+    {
+        connect();
+    }
+    else
+    {
+        LOG_DEBUG("Connector::startInLoop do not connect \n");
+    }
+}
+
+void Connector::stopInLoop()
+{
+    if (retryPending_)
+    {
+        loop_->cancel(retryTimer_);
+        retryPending_ = false;
+    }
+    if (state_ == kConnecting)
+    {
+        setState(kDisconnected);
+        int sockfd = removeAndResetChannel();
+        ::close(sockfd);
+    }
+}
+
+void Connector::connect()
+{
+    int sockfd = createNonblocking();
+    int ret = ::connect(sockfd, (sockaddr*)serverAddr_.getSockAddr(), sizeof(sockaddr_in));
+    int savedErrno = (ret == 0) ? 0 : errno;
+    switch (savedErrno)
+    {
+    case 0:
+    case EINPROGRESS:
+    case EINTR:
+    case EISCONN:
+        connecting(sockfd);
+        break;
+
+    // 临时端口用完了、对端没有监听、网络暂时不可达 过一会再试
+    case EAGAIN:
+    case EADDRINUSE:
+    case EADDRNOTAVAIL:
+    case ECONNREFUSED:
+    case ENETUNREACH:
+    case EHOSTUNREACH:
+    case ETIMEDOUT:
+        retry(sockfd);
+        break;
+
+    // 参数或者权限的问题 重试也没用
+    case EACCES:
+    case EPERM:
+    case EAFNOSUPPORT:
+    case EALREADY:
+    case EBADF:
+    case EFAULT:
+    case ENOTSOCK:
+        LOG_ERROR("Connector::connect %s error:%d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        break;
+
+    default:
+        LOG_ERROR("Connector::connect %s unexpected error:%d \n", serverAddr_.toIpPort().c_str(), savedErrno);
+        ::close(sockfd);
+        break;
+    }
+}
+
+void Connector::connecting(int sockfd)
+{
+    setState(kConnecting);
+    channel_.reset(new Channel(loop_, sockfd));
+    // channel_只在loop线程里用 生命周期由Connector管，不需要tie
+    channel_->setWriteCallback(std::bind(&Connector::handleWrite, this));
+    channel_->setErrorCallback(std::bind(&Connector::handleError, this));
+    channel_->enableWriting();
+}
+
+int Connector::removeAndResetChannel()
+{
+    channel_->disableAll();
+    channel_->remove();
+    int sockfd = channel_->fd();
+    // 现在还在Channel::handleEvent里面 不能马上析构channel，转交给一个任务，本轮回调都执行完以后再释放
+    std::shared_ptr<Channel> channel(channel_.release());
+    loop_->queueInLoop([channel]() {});
+    return sockfd;
+}
+
+void Connector::handleWrite()
+{
+    if (state_ != kConnecting)
+    {
+        return;
+    }
+    int sockfd = removeAndResetChannel();
+    int err = getSocketError(sockfd);
+    if (err)
+    {
+        LOG_INFO("Connector::handleWrite %s SO_ERROR=%d %s \n", serverAddr_.toIpPort().c_str(), err, strerror(err));
+        retry(sockfd);
+    }
+    else if (isSelfConnect(sockfd))
+    {
+        LOG_ERROR("Connector::handleWrite %s self connect \n", serverAddr_.toIpPort().c_str());
+        retry(sockfd);
+    }
+    else
+    {
+        setState(kConnected);
+        connectedTime_ = Timestamp::now(); // 重试间隔等连接稳定以后在restart里重置
+        if (connect_ && newConnectionCallback_)
+        {
+            newConnectionCallback_(sockfd);
+        }
+        else
+        {
+            ::close(sockfd);
+        }
+    }
+}
+
+void Connector::handleError()
+{
+    if (state_ == kConnecting)
+    {
+        int sockfd = removeAndResetChannel();
+        int err = getSocketError(sockfd);
+        LOG_INFO("Connector::handleError %s SO_ERROR=%d %s \n", serverAddr_.toIpPort().c_str(), err, strerror(err));
+        retry(sockfd);
+    }
+}
+
+void Connector::retry(int sockfd)
+{
+    ::close(sockfd);
+    setState(kDisconnected);
+    scheduleRetry();
+}
+
+void Connector::scheduleRetry()
+{
+    if (!connect_)
+    {
+        LOG_DEBUG("Connector::retry do not connect \n");
+        return;
+    }
+    if (retryPending_)
+    {
+        return;
+    }
+    // 在[retryDelay_/2, retryDelay_]之间随机 避免大量连接同时重连
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    double delay = retryDelay_ * jitter(random_);
+    LOG_INFO("Connector::retry connecting to %s in %f seconds \n", serverAddr_.toIpPort().c_str(), delay);
+    retryTimer_ = loop_->runAfter(delay, std::bind(&Connector::startInLoop, shared_from_this()));
+    retryPending_ = true;
+    retryDelay_ = std::min(retryDelay_ * 2, maxRetryDelay_);
+}
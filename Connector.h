@@ -0,0 +1,77 @@
+#pragma once
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "TimerId.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <random>
+
+class Channel;
+class EventLoop;
+
+/**
+ * 主动发起连接 给TcpClient用，和Acceptor是对称的：Acceptor接受连接，Connector发起连接，拿到sockfd以后都交给上层建TcpConnection
+ *
+ * 非阻塞connect返回EINPROGRESS以后把socket注册写事件，socket可写的时候用SO_ERROR确认到底连上了没有，
+ * 还要排除自连接(目标是本机没人监听的端口时，内核分配的临时端口可能正好等于目标端口，自己连上自己)
+ * 连上以后sockfd交给newConnectionCallback_，Connector不再管这个fd
+ *
+ * 连接失败关掉socket，过一段时间再重试 间隔从initRetryDelay开始每次翻倍，最多maxRetryDelay，
+ * 实际等待的时间在[间隔/2, 间隔]里随机取，成千上万个客户端同时断开的时候重连不会挤在同一时刻
+ * 所有的状态都只在loop线程里修改
+*/
+class Connector : noncopyable, public std::enable_shared_from_this<Connector>
+{
+public:
+    using NewConnectionCallback = std::function<void (int sockfd)>;
+
+    Connector(EventLoop *loop, const InetAddress &serverAddr);
+    ~Connector();
+
+    void setNewConnectionCallback(const NewConnectionCallback &cb) {newConnectionCallback_ = cb;}
+    // 重试间隔 在start之前设置
+    void setRetryDelay(double initSeconds, double maxSeconds);
+
+    const InetAddress& serverAddress() const {return serverAddr_;}
+
+    void start(); // 线程安全
+    // 只能在loop线程中调用 连接断开以后重新连，和失败重试一样等一个带抖动的间隔
+    // 上一条连接保持了足够久间隔才从initRetryDelay开始，否则接着翻倍
+    void restart();
+    void stop(); // 线程安全 正在连接的socket关掉，等待中的重试取消
+
+private:
+    enum States {kDisconnected, kConnecting, kConnected};
+
+    void setState(States s) {state_ = s;}
+    void startInLoop();
+    void stopInLoop();
+    void connect();
+    void connecting(int sockfd);
+    void handleWrite();
+    void handleError();
+    void retry(int sockfd);
+    void scheduleRetry();
+    // 连接有了结果以后channel就没用了 返回它的fd
+    int removeAndResetChannel();
+
+    EventLoop *loop_;
+    InetAddress serverAddr_;
+    std::atomic_bool connect_; // 用户是否希望连接 stop以后为false
+    std::atomic_int state_;
+    std::unique_ptr<Channel> channel_; // 只在kConnecting的时候存在
+    NewConnectionCallback newConnectionCallback_;
+
+    double initRetryDelay_;
+    double maxRetryDelay_;
+    double retryDelay_; // 下一次重试的间隔上限
+    TimerId retryTimer_;
+    bool retryPending_;
+    Timestamp connectedTime_; // 上一次连上的时间
+    std::minstd_rand random_; // 抖动用
+};
+
+using ConnectorPtr = std::shared_ptr<Connector>;
@@ -1,13 +1,35 @@
 #include "Poller.h"
 #include "EpollPoller.h"
-//#include "PollPoller.h"
+#include "IoUringPoller.h"
+#include "PollPoller.h"
+#include "Logger.h"
 
 #include <stdlib.h>  // getenv()
-Poller* Poller::newDefaultPoller(EventLoop *loop)
+Poller* Poller::newDefaultPoller(EventLoop *loop, EventLoop::PollerType type)
 {
-    if(::getenv("MUDUO_USE_POLL")) {
-        return nullptr; //生成poll实例
-    }else {
-        return new EpollPoller(loop); //生成epoll实例
+    if (type == EventLoop::kDefault)
+    {
+        if(::getenv("MUDUO_USE_POLL")) {
+            type = EventLoop::kPoll;
+        } else if (::getenv("MUDUO_USE_URING")) {
+            type = EventLoop::kIoUring;
+        } else {
+            type = EventLoop::kEpoll;
+        }
     }
-}
\ No newline at end of file
+
+    if (type == EventLoop::kPoll)
+    {
+        return new PollPoller(loop); //生成poll实例
+    }
+    if (type == EventLoop::kIoUring)
+    {
+        Poller *poller = IoUringPoller::newIoUringPoller(loop); //生成io_uring实例
+        if (poller)
+        {
+            return poller;
+        }
+        LOG_INFO("io_uring unavailable, fall back to epoll \n");
+    }
+    return new EpollPoller(loop); //生成epoll实例
+}
@@ -30,8 +30,8 @@ EpollPoller::~EpollPoller() {
 
 Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 {
-    //实际应该用LOG_DEBUG输出日志更为合理
-    LOG_INFO("func=%s => fd total count:%lu \n", __FUNCTION__, channels_.size());
+    //每次poll都会执行 用LOG_DEBUG输出日志更为合理
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels_);
 
 // 把监听到的event I/O变化保存如 vector
 // events_是epoll_event的vector形式，通过begin() 获取首元素迭代器 然后再解引用再取地址得到epoll_event的指针，static_cast<int> c++安全换转
@@ -42,7 +42,7 @@ Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 
     if (numEvents > 0)
     {
-        LOG_INFO("%d events happen \n,", numEvents);
+        LOG_DEBUG("%d events happen \n", numEvents);
         fillActiveChannels(numEvents, activeChannels);
         if (numEvents == events_.size())
         {
@@ -73,7 +73,7 @@ Timestamp EpollPoller::poll(int timeoutMs, ChannelList *activeChannels)
 void EpollPoller::updateChannel(Channel *channel)
 {
     const int index = channel -> index();
-    LOG_INFO("func=%s => fd=%d events=%d index=%d \n",__FUNCTION__, channel -> fd(), channel -> events(), index);
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n",__FUNCTION__, channel -> fd(), channel -> events(), index);
 
 //逻辑是如果碰到新channel和之前已经被弃用的channel，则添加channel进入channelmap，因为调用方并不知道channel是否已经
 //被添加进入channelmap，调用方只是更改该兴趣的事件，所以需要根据index来判断是否已经存在于channelMap channels_中 
@@ -81,10 +81,15 @@ void EpollPoller::updateChannel(Channel *channel)
     {
         if (index == kNew)
         {
-            int fd = channel -> fd();
-            channels_[fd] = channel;
+            addChannel(channel);
         }
 
+        if (channel -> isNoneEvent())
+        {
+            //一轮里先enable又disable 提交的时候已经什么都不关心了 不用上树
+            channel -> set_index(kDeleted);
+            return;
+        }
         channel -> set_index(kAdded);
         update(EPOLL_CTL_ADD, channel);
     }
@@ -96,9 +101,11 @@ void EpollPoller::updateChannel(Channel *channel)
             update(EPOLL_CTL_DEL, channel);
             channel -> set_index(kDeleted);
         }
-        else{
+        else if (channelEntry(fd).registeredEvents != epollEvents(channel))
+        {
             update(EPOLL_CTL_MOD, channel);
         }
+        //注册的事件没有变化(比如重复enableReading) 不需要epoll_ctl
     }
 }
 
@@ -110,9 +117,9 @@ void EpollPoller::updateChannel(Channel *channel)
 void EpollPoller::removeChannel(Channel* channel)
 {
     int fd = channel -> fd();
-    channels_.erase(fd);
+    eraseChannel(fd);
 
-    LOG_INFO("func=%s => fd=%d\n", __FUNCTION__, fd);
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
 
     int index = channel -> index();
     if (index == kAdded)
@@ -140,10 +147,11 @@ void EpollPoller::update(int operation, Channel* channel)
 
     int fd = channel -> fd();
 
-    event.events = channel -> events();
+    event.events = epollEvents(channel);
     event.data.fd = fd; //该代码错误，data是union集合 只能赋值一次，所以不能同时赋予ptr和fd 这里只是和视频代码保持一致 
     event.data.ptr = channel;
 
+    countCtl();
     if (::epoll_ctl(epollfd_, operation, fd, &event) < 0)
     {
         if (operation == EPOLL_CTL_DEL)
@@ -154,4 +162,16 @@ void EpollPoller::update(int operation, Channel* channel)
             LOG_FATAL("epoll_ctl add/mod error:%d\n", errno);
         }
     }
+    channelEntry(fd).registeredEvents = operation == EPOLL_CTL_DEL ? 0 : event.events;
+}
+
+//channel想要注册到epoll上的事件
+int EpollPoller::epollEvents(const Channel* channel)
+{
+    int events = channel -> events();
+    if (channel -> edgeTriggered())
+    {
+        events |= EPOLLET;
+    }
+    return events;
 }
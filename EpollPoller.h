@@ -25,6 +25,7 @@ public:
     Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
     void updateChannel(Channel* channel) override;
     void removeChannel(Channel* channel) override;
+    EventLoop::PollerType type() const override {return EventLoop::kEpoll;}
 
 private:
     static const int kInitEventListSize = 16;
@@ -33,6 +34,7 @@ private:
     void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
     //更新channel通道
     void update(int operation, Channel* channel);
+    static int epollEvents(const Channel* channel);
 
     using EventList = std::vector<epoll_event>;
 
@@ -2,6 +2,9 @@
 #include "Logger.h"
 #include "Poller.h"
 #include "Channel.h"
+#include "TimerQueue.h"
+#include "TimingWheel.h"
+#include "BufferPool.h"
 
 
 #include <sys/eventfd.h>
@@ -9,6 +12,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <memory>
+#include <algorithm>
 
 
 //防止一个线程创建多个EventLoop, eventLoop是全局变量，当不为null的时候 就不再创建
@@ -19,6 +23,15 @@ __thread EventLoop *t_loopInThisThread = nullptr;
 //定义默认的Poller的 IO复用接口的超时时间
 const int kPollTimeMs = 10000;
 
+//自旋预算的下限 预算减半不会低于这个值
+const int64_t kMinSpinBudgetNanos = 1000;
+
+//统计计数只有loop线程写，不需要原子的加法 load + store就够了
+static inline void addCounter(std::atomic<int64_t> &counter, int64_t delta)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
 //创建wakeupfd，用来notify唤醒subReactor处理新来的channel
 int createFd(){
     int evtfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
@@ -29,15 +42,30 @@ int createFd(){
 }
 
 // 每个eventloop都有一个单独的epollfd，用来上树和下树channel
-EventLoop:: EventLoop()
+EventLoop:: EventLoop(PollerType pollerType)
     : looping_(false),
+      iteration_(0),
       quit_(false),
       callingPendingFunctors_(false),
       threadId_(CurrentThread::tid()), //tid是inline方法
-      poller_(Poller::newDefaultPoller(this)),
+      channelUpdates_(0),
+      ctlAvoided_(0),
+      poller_(Poller::newDefaultPoller(this, pollerType)),
+      timerQueue_(new TimerQueue(this)),
+      timingWheel_(new TimingWheel(this)),
+      bufferPool_(new BufferPool(this)),
       wakeupFd_(createFd()),
       wakeupChannel_(new Channel(this, wakeupFd_)),
-      currentActiveChannel_(nullptr){
+      wakeupPending_(false),
+      currentActiveChannel_(nullptr),
+      busyPollMaxNanos_(0),
+      spinBudgetNanos_(0),
+      spinNanos_(0),
+      workNanos_(0),
+      spinPolls_(0),
+      spinHits_(0),
+      blockingPolls_(0),
+      budgetNanos_(0){
         LOG_DEBUG("EventLoop created %p in thread %d \n", this, threadId_);
 
         if (t_loopInThisThread){
@@ -70,8 +98,20 @@ EventLoop:: EventLoop()
 
         while(!quit_){
             activeChannels_.clear();
+            //上一轮回调里对channel的修改 在poll之前一次性提交 忙轮询自旋期间不会再有新的修改
+            commitChannelUpdates();
             //监听两类fd 一种是client的fd，一种是wakeup fd
-            pollReturnTime_ = poller_ -> poll(kPollTimeMs, &activeChannels_);
+            const bool busyPolling = busyPollMaxNanos_.load(std::memory_order_relaxed) > 0;
+            if (busyPolling)
+            {
+                pollReturnTime_ = busyPoll();
+            }
+            else
+            {
+                pollReturnTime_ = poller_ -> poll(kPollTimeMs, &activeChannels_);
+            }
+            addCounter(iteration_, 1);
+            int64_t workStart = busyPolling ? Timestamp::monotonicNanos() : 0;
 
             for (Channel *channel : activeChannels_)
             {
@@ -85,12 +125,86 @@ EventLoop:: EventLoop()
             * 这里的callback都放在vector<Functor>中
             */
             doPendingFunctors();
+
+            if (busyPolling)
+            {
+                addCounter(workNanos_, Timestamp::monotonicNanos() - workStart);
+            }
         }
 
         LOG_INFO("EventLoop %p stop looping. \n", this);
         looping_ = false;
       }
 
+      void EventLoop::setBusyPoll(int64_t maxSpinMicroSeconds)
+      {
+        busyPollMaxNanos_.store(maxSpinMicroSeconds > 0 ? maxSpinMicroSeconds * 1000 : 0,
+                                std::memory_order_relaxed);
+      }
+
+      EventLoop::BusyPollStats EventLoop::busyPollStats() const
+      {
+        BusyPollStats stats;
+        stats.spinNanos = spinNanos_.load(std::memory_order_relaxed);
+        stats.workNanos = workNanos_.load(std::memory_order_relaxed);
+        stats.spinPolls = spinPolls_.load(std::memory_order_relaxed);
+        stats.spinHits = spinHits_.load(std::memory_order_relaxed);
+        stats.blockingPolls = blockingPolls_.load(std::memory_order_relaxed);
+        stats.budgetNanos = budgetNanos_.load(std::memory_order_relaxed);
+        return stats;
+      }
+
+      //先用超时为0的poll自旋 预算用完还没有事件就阻塞
+      Timestamp EventLoop::busyPoll()
+      {
+        const int64_t maxBudget = busyPollMaxNanos_.load(std::memory_order_relaxed);
+        const int64_t minBudget = std::min(maxBudget, kMinSpinBudgetNanos);
+        if (spinBudgetNanos_ <= 0 || spinBudgetNanos_ > maxBudget)
+        {
+            spinBudgetNanos_ = maxBudget; //刚打开或者上限被调小了
+        }
+
+        const int64_t start = Timestamp::monotonicNanos();
+        const int64_t deadline = start + spinBudgetNanos_;
+        int64_t now = start;
+        int64_t polls = 0;
+        Timestamp receiveTime;
+        do
+        {
+            receiveTime = poller_ -> poll(0, &activeChannels_);
+            ++polls;
+            now = Timestamp::monotonicNanos();
+        } while (activeChannels_.empty() && now < deadline && !quit_);
+
+        addCounter(spinNanos_, now - start);
+        addCounter(spinPolls_, polls);
+
+        if (!activeChannels_.empty())
+        {
+            //自旋有收获 说明负载高 下次多转一会儿
+            addCounter(spinHits_, 1);
+            spinBudgetNanos_ = std::min(maxBudget, spinBudgetNanos_ * 2);
+        }
+        else if (!quit_)
+        {
+            addCounter(blockingPolls_, 1);
+            receiveTime = poller_ -> poll(kPollTimeMs, &activeChannels_);
+            const int64_t blocked = Timestamp::monotonicNanos() - now;
+            if (!activeChannels_.empty() && blocked < maxBudget)
+            {
+                //事件在预算用完后不久就来了 多自旋一会儿本来可以接住它
+                spinBudgetNanos_ = std::min(maxBudget, spinBudgetNanos_ * 2);
+            }
+            else
+            {
+                //空闲了很久 下次早点去睡 省CPU
+                spinBudgetNanos_ = std::max(minBudget, spinBudgetNanos_ / 2);
+            }
+        }
+        budgetNanos_.store(spinBudgetNanos_, std::memory_order_relaxed);
+        return receiveTime;
+      }
+
       //
 // 退出事件循环  1.loop在自己的线程中调用quit  2.在非loop的线程中，调用loop的quit
 /**
@@ -127,14 +241,13 @@ EventLoop:: EventLoop()
       //把cb放入队列中，唤醒loop所在的线程，执行cb
       void EventLoop::queueInLoop(Functor cb)
       {
-        {
-            //因为可能多个线程需要往vector里面加callback 所以需要锁来控制
-            std::unique_lock<std::mutex> lock(mutex_);
-            pendingFunctors_.emplace_back(cb);
-        }
+        //无锁队列 多个线程可以同时push
+        pendingFunctors_.push(std::move(cb));
 
         //唤醒相应的，需要执行上面回调操作的的loop的线程
         // || callPendingFunctors_的意思是：当前loop正在执行回调，但是loop又有了新的回调
+        //loop线程自己在其他地方push的，本轮结束前doPendingFunctors会一起处理
+        //wakeup只在没有未处理的唤醒时才写wakeupFd_ 所以多个线程连续push只有第一次有系统调用
         if (!isInLoopThread() || callingPendingFunctors_)
         {
             wakeup(); //唤醒loop所在线程
@@ -149,11 +262,20 @@ EventLoop:: EventLoop()
         {
             LOG_ERROR("EventLoop::handleRead() reads %lu bytes instead of 8", n); //这个channel只是用来唤醒eventloop 实际内容无所谓
         }
+        //先读再清标志：反过来的话，清完标志到read之间别的线程写进来的那一次会被这次read一起读掉，
+        //标志却一直是true，之后所有的wakeup都不写了
+        //读完到清标志之间的wakeup虽然没写，但是它们push的回调本轮doPendingFunctors会执行，
+        //acq_rel和wakeup里的exchange配对，保证看得到这些回调
+        wakeupPending_.exchange(false, std::memory_order_acq_rel);
       }
 
       //用来唤醒loop所在的线程，向wakeupfd_写一个数据，wakeupChannel就发生读事件，当前loop线程就被唤醒了
       void EventLoop::wakeup()
       {
+        if (wakeupPending_.exchange(true, std::memory_order_acq_rel))
+        {
+            return; //loop已经会被唤醒了
+        }
         uint64_t one = 1;
         ssize_t n = write(wakeupFd_, &one, sizeof one);
         if (n != sizeof one)
@@ -162,35 +284,102 @@ EventLoop:: EventLoop()
         }
       }
 
+      TimerId EventLoop::runAt(Timestamp time, TimerCallback cb)
+      {
+        return timerQueue_ -> addTimer(std::move(cb), time, 0.0);
+      }
+
+      TimerId EventLoop::runAfter(double delay, TimerCallback cb)
+      {
+        Timestamp time(addTime(Timestamp::now(), delay));
+        return runAt(time, std::move(cb));
+      }
+
+      TimerId EventLoop::runEvery(double interval, TimerCallback cb)
+      {
+        Timestamp time(addTime(Timestamp::now(), interval));
+        return timerQueue_ -> addTimer(std::move(cb), time, interval);
+      }
+
+      void EventLoop::cancel(TimerId timerId)
+      {
+        timerQueue_ -> cancel(timerId);
+      }
+
       //EventLoop的方法 -> Poller的方法
       void EventLoop::updateChannel(Channel * channel)
       {
-        poller_ -> updateChannel(channel);
+        addCounter(channelUpdates_, 1);
+        if (channel -> updateQueued())
+        {
+            //本轮已经记下来了 提交的时候按最新的events_来 这次修改被合并掉了
+            addCounter(ctlAvoided_, 1);
+            return;
+        }
+        channel -> setUpdateQueued(true);
+        updatedChannels_.push_back(channel);
       }
 
         void EventLoop::removeChannel(Channel * channel)
       {
+        if (channel -> updateQueued())
+        {
+            //channel马上就要析构了 待提交的修改不能再留着
+            channel -> setUpdateQueued(false);
+            updatedChannels_.erase(std::find(updatedChannels_.begin(), updatedChannels_.end(), channel));
+            addCounter(ctlAvoided_, 1);
+        }
         poller_ -> removeChannel(channel);
       }
 
         bool EventLoop::hasChannel(Channel * channel)
       {
-        return poller_ -> hasChannel(channel);
+        return channel -> updateQueued() || poller_ -> hasChannel(channel);
+      }
+
+      void EventLoop::commitChannelUpdates()
+      {
+        for (Channel *channel : updatedChannels_)
+        {
+            channel -> setUpdateQueued(false);
+            int64_t before = poller_ -> ctlCalls();
+            poller_ -> updateChannel(channel);
+            if (poller_ -> ctlCalls() == before)
+            {
+                //最终的events_和内核里注册的一样 比如enableWriting以后又disableWriting
+                addCounter(ctlAvoided_, 1);
+            }
+        }
+        updatedChannels_.clear();
+      }
+
+      bool EventLoop::edgeTriggeredSupported() const
+      {
+        return poller_ -> edgeTriggeredSupported();
+      }
+
+      EventLoop::PollerType EventLoop::pollerType() const
+      {
+        return poller_ -> type();
+      }
+
+      EventLoop::InterestStats EventLoop::interestStats() const
+      {
+        InterestStats stats;
+        stats.updates = channelUpdates_.load(std::memory_order_relaxed);
+        stats.ctlCalls = poller_ -> ctlCalls();
+        stats.ctlAvoided = ctlAvoided_.load(std::memory_order_relaxed);
+        return stats;
       }
 
       //执行回调
       void EventLoop::doPendingFunctors() //执行回调
       {
-        std::vector<Functor> functors;
         callingPendingFunctors_ = true;
-        {
-            std::unique_lock<std::mutex> lock(mutex_);
-            functors.swap(pendingFunctors_);
-        }
-        for (const Functor &functor : functors)
-        {
+        //一次性把队列里的回调全部取出来执行，执行期间新加入的回调留到下一轮
+        pendingFunctors_.consumeAll([](Functor &functor) {
             functor(); //执行当前loop需要执行的回调操作
-        }
+        });
         callingPendingFunctors_ = false;
       }
 
@@ -9,17 +9,47 @@
 #include "noncopyable.h"
 #include "Timestamp.h"
 #include "CurrentThread.h"
+#include "Callbacks.h"
+#include "TimerId.h"
+#include "MpscQueue.h"
 
 
 class Channel;
 class Poller;
 class Time;
+class TimerQueue;
+class TimingWheel;
+class BufferPool;
 
 //时间循环类 主要包含了两个大木块 Channel Poller（epoll的抽象）
 class EventLoop : noncopyable {
     public:
         using Functor = std::function<void()>;
-        EventLoop();
+
+        //忙轮询的统计 单位都是纳秒 任意线程都可以读
+        struct BusyPollStats
+        {
+            int64_t spinNanos; //自旋(超时为0的poll)花掉的时间
+            int64_t workNanos; //处理事件和回调花掉的时间
+            int64_t spinPolls; //自旋期间调用poll的次数
+            int64_t spinHits; //自旋期间拿到了事件的次数
+            int64_t blockingPolls; //自旋预算用完 退回阻塞poll的次数
+            int64_t budgetNanos; //当前的自旋预算
+        };
+
+        //Poller的实现 kDefault按环境变量选择: MUDUO_USE_POLL用poll MUDUO_USE_URING用io_uring 否则用epoll
+        //io_uring在内核不支持或者被禁用的时候自动退回epoll
+        enum PollerType {kDefault, kEpoll, kIoUring, kPoll};
+
+        //兴趣事件修改的统计 只由loop线程写 任意线程都可以读
+        struct InterestStats
+        {
+            int64_t updates; //Channel::update的调用次数
+            int64_t ctlCalls; //真正提交给内核的修改次数(epoll_ctl/io_uring的poll请求 包括removeChannel)
+            int64_t ctlAvoided; //被合并或者互相抵消 没有提交给内核的修改次数
+        };
+
+        explicit EventLoop(PollerType pollerType = kDefault);
         ~EventLoop();
 
         //开启事件循环
@@ -27,6 +57,7 @@ class EventLoop : noncopyable {
         //退出事件循环
         void quit();
 
+        //每轮epoll_wait返回以后只读一次时钟，本轮所有回调和定时器都用这个缓存的时间
         Timestamp pollReturnTime() const {return pollReturnTime_;}
 
         //在当前loop中执行回调
@@ -34,13 +65,44 @@ class EventLoop : noncopyable {
         //把cb放入队列中，唤醒loop所在的线程，执行cb
         void queueInLoop(Functor cb);
 
-        //用来唤醒loop所在的线程
+        //用来唤醒loop所在的线程 loop读走上一次唤醒之前重复调用只写一次wakeupFd_
         void wakeup();
 
+        //定时器 都是线程安全的 回调在loop所在的线程中执行
+        //在time时刻执行cb
+        TimerId runAt(Timestamp time, TimerCallback cb);
+        //delay秒以后执行cb
+        TimerId runAfter(double delay, TimerCallback cb);
+        //每隔interval秒执行一次cb
+        TimerId runEvery(double interval, TimerCallback cb);
+        //取消定时器
+        void cancel(TimerId timerId);
+
+        //忙轮询模式 epoll_wait阻塞再被唤醒要几十微秒，延迟敏感的loop可以先用超时为0的poll自旋，
+        //最多自旋maxSpinMicroSeconds微秒还没有事件再退回阻塞poll。自旋预算根据负载自动调整：
+        //自旋期间或者阻塞后不到maxSpin就拿到事件，预算加倍；阻塞了很久才有事件，预算减半。0表示关闭(默认)
+        //可以在任意线程调用，一般在EventLoopThreadPool的ThreadInitCallBack里给指定的loop打开
+        void setBusyPoll(int64_t maxSpinMicroSeconds);
+        BusyPollStats busyPollStats() const;
+
+        //连接的空闲/读/写超时都挂在这个时间轮上 只能在loop线程中使用
+        TimingWheel* timingWheel() const {return timingWheel_.get();}
+        //连接的输入/输出缓冲区从这里借底层存储 只能在loop线程中使用
+        BufferPool* bufferPool() const {return bufferPool_.get();}
+
         //EventLoop的方法 -> Poller的方法
+        //updateChannel只是把channel记下来，本轮所有的修改在下一次poll之前一次性提交，
+        //同一个channel一轮里改多次只提交最后的状态，和内核里已经注册的一样就不提交
         void updateChannel(Channel* channel);
         void removeChannel(Channel* channel);
         bool hasChannel(Channel* channel);
+        InterestStats interestStats() const;
+        //poller是否支持边沿触发
+        bool edgeTriggeredSupported() const;
+        //实际选中的poller 构造时要求io_uring但是内核不支持的时候是kEpoll
+        PollerType pollerType() const;
+        //loop已经执行了多少轮(poll的次数)
+        int64_t iteration() const {return iteration_.load(std::memory_order_relaxed);}
 
         //判断eventLoop对象是否在自己的线程里面
         bool isInLoopThread() const {return threadId_ == CurrentThread::tid();}
@@ -48,26 +110,49 @@ class EventLoop : noncopyable {
     private:
         void handleRead(); //wake up
         void doPendingFunctors(); //执行回调
+        //忙轮询模式下的poll 先自旋再阻塞
+        Timestamp busyPoll();
+        //把本轮攒下来的channel修改提交给poller
+        void commitChannelUpdates();
 
         using ChannelList = std::vector<Channel*>;
 
         std::atomic_bool looping_; //原子操作，通过CAS实现
+        std::atomic<int64_t> iteration_;
         std::atomic_bool quit_; //标志退出loop循环
         const pid_t threadId_; //记录当前loop所在线程的id
 
         Timestamp pollReturnTime_; //poller返回发生事件的channels的时间点
+        //本轮修改过兴趣事件 还没有提交给poller的channel
+        //timerQueue_析构的时候还会update/remove自己的channel 所以要声明在它们前面
+        ChannelList updatedChannels_;
+        std::atomic<int64_t> channelUpdates_;
+        std::atomic<int64_t> ctlAvoided_;
         std::unique_ptr<Poller> poller_;
+        std::unique_ptr<TimerQueue> timerQueue_; //必须在poller_之后构造 因为timerfd要注册到poller上
+        std::unique_ptr<TimingWheel> timingWheel_; //由timerQueue_驱动 必须在它之后构造
+        std::unique_ptr<BufferPool> bufferPool_;
 
         int wakeupFd_; // 当mainLoop获取一个新用户的channel，通过轮询算法选择一个subLoop，通过该成员唤醒subLoop处理channel
         std::unique_ptr<Channel> wakeupChannel_;
+        std::atomic_bool wakeupPending_; //已经写过wakeupFd_、loop还没读 这期间的wakeup不用再写
 
         //scratch variables
         ChannelList activeChannels_;
         Channel* currentActiveChannel_; //主要用作断言操作 可用可不用
 
+        //忙轮询 统计只由loop线程写 其他线程读
+        std::atomic<int64_t> busyPollMaxNanos_;
+        int64_t spinBudgetNanos_;
+        std::atomic<int64_t> spinNanos_;
+        std::atomic<int64_t> workNanos_;
+        std::atomic<int64_t> spinPolls_;
+        std::atomic<int64_t> spinHits_;
+        std::atomic<int64_t> blockingPolls_;
+        std::atomic<int64_t> budgetNanos_;
+
         std::atomic_bool callingPendingFunctors_; //标志当前loop是否有需要执行的loop操作
-        std::vector<Functor> pendingFunctors_; //存储loop需要执行的的所有回调操作
-        std::mutex mutex_; //互斥锁 用来保护上面vector的线程安全操作
+        MpscQueue<Functor> pendingFunctors_; //存储loop需要执行的的所有回调操作 无锁队列 其他线程可以直接push
 
 
 };
\ No newline at end of file
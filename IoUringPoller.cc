@@ -0,0 +1,514 @@
+#include "IoUringPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// 和EpollPoller中channel的index_含义一样
+const int kNew = -1;
+const int kAdded = 1;
+const int kDeleted = 2;
+
+namespace
+{
+
+int ioUringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags, void *arg, size_t argSize)
+{
+    return static_cast<int>(::syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+// 环的head/tail和内核共享 需要acquire/release语义
+unsigned loadAcquire(const unsigned *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void storeRelease(unsigned *p, unsigned value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+uint64_t makeUserData(int fd, uint32_t generation)
+{
+    return (static_cast<uint64_t>(fd) << 32) | generation;
+}
+
+}
+
+IoUringPoller* IoUringPoller::newIoUringPoller(EventLoop *loop)
+{
+    IoUringPoller *poller = new IoUringPoller(loop);
+    if (!poller->init())
+    {
+        delete poller;
+        return nullptr;
+    }
+    return poller;
+}
+
+IoUringPoller::IoUringPoller(EventLoop *loop)
+    : Poller(loop)
+    , ringFd_(-1)
+    , features_(0)
+    , multishotSupported_(true)
+    , sqRing_(MAP_FAILED)
+    , sqRingSize_(0)
+    , cqRing_(MAP_FAILED)
+    , cqRingSize_(0)
+    , sqes_(nullptr)
+    , sqesSize_(0)
+    , sqHead_(nullptr)
+    , sqTail_(nullptr)
+    , sqMask_(nullptr)
+    , sqEntries_(nullptr)
+    , sqFlags_(nullptr)
+    , sqArray_(nullptr)
+    , cqHead_(nullptr)
+    , cqTail_(nullptr)
+    , cqMask_(nullptr)
+    , cqes_(nullptr)
+    , toSubmit_(0)
+{
+}
+
+IoUringPoller::~IoUringPoller()
+{
+    if (sqes_)
+    {
+        ::munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_)
+    {
+        ::munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED)
+    {
+        ::munmap(sqRing_, sqRingSize_);
+    }
+    if (ringFd_ >= 0)
+    {
+        ::close(ringFd_);
+    }
+}
+
+bool IoUringPoller::init()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+    // 每个channel都挂着一个poll请求 一轮的完成事件可能比SQ大很多 CQ单独放大
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = kCqEntries;
+
+    ringFd_ = ioUringSetup(kSqEntries, &params);
+    if (ringFd_ < 0)
+    {
+        LOG_INFO("io_uring_setup error:%d \n", errno);
+        return false;
+    }
+    features_ = params.features;
+    // 带超时的等待需要IORING_ENTER_EXT_ARG(5.11) 没有的话还不如用epoll
+    if (!(features_ & IORING_FEAT_EXT_ARG))
+    {
+        LOG_INFO("io_uring lacks IORING_FEAT_EXT_ARG features=%u \n", features_);
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = features_ & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+    }
+
+    sqRing_ = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sq ring error:%d \n", errno);
+        return false;
+    }
+    if (singleMmap)
+    {
+        cqRing_ = sqRing_;
+    }
+    else
+    {
+        cqRing_ = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ringFd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED)
+        {
+            LOG_ERROR("io_uring mmap cq ring error:%d \n", errno);
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        LOG_ERROR("io_uring mmap sqes error:%d \n", errno);
+        return false;
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqFlags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char *cq = static_cast<char*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    multishotSupported_ = probeMultishot();
+    LOG_INFO("io_uring poller ready sq=%u cq=%u features=%u multishot=%d \n",
+             params.sq_entries, params.cq_entries, features_, multishotSupported_);
+    return true;
+}
+
+// 5.13以前的内核不认识IORING_POLL_ADD_MULTI 没有multishot就没法做边沿触发
+// 对一个eventfd挂multishot的POLLOUT eventfd总是可写 马上就能拿到结果
+bool IoUringPoller::probeMultishot()
+{
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = kProbeUserData;
+    enter(1, 1000);
+
+    bool supported = false;
+    unsigned head = *cqHead_;
+    unsigned tail = loadAcquire(cqTail_);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+        if (cqe.user_data == kProbeUserData)
+        {
+            supported = cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE);
+        }
+    }
+    storeRelease(cqHead_, head);
+
+    // 撤掉探测请求 被撤掉时的-ECANCELED在reapCompletions里按未知fd丢弃
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = kProbeUserData;
+    sqe->user_data = kIgnoredUserData;
+    enter(0, 0);
+    ::close(fd);
+    return supported;
+}
+
+Timestamp IoUringPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels_);
+
+    // 上一轮触发过的单次poll重新挂上去 和下面的等待合并成一次io_uring_enter
+    rearmPending();
+    reapCompletions();
+
+    int ret = 0;
+    if (activeFds_.empty())
+    {
+        ret = enter(1, timeoutMs);
+    }
+    else if (toSubmit_ > 0)
+    {
+        ret = enter(0, 0);
+    }
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    reapCompletions();
+    // CQ满了以后内核把完成事件暂存起来 需要再进一次内核把它们刷到CQ里
+    while (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+    {
+        enter(0, 0);
+        if (reapCompletions() == 0)
+        {
+            break;
+        }
+    }
+
+    if (!activeFds_.empty())
+    {
+        LOG_DEBUG("%lu events happen \n", activeFds_.size());
+        fillActiveChannels(activeChannels);
+    }
+    else if (ret < 0 && saveErrno != ETIME && saveErrno != EINTR)
+    {
+        errno = saveErrno;
+        LOG_ERROR("IoUringPoller::poll() err:%d \n", saveErrno);
+    }
+    return now;
+}
+
+void IoUringPoller::updateChannel(Channel *channel)
+{
+    const int index = channel->index();
+    const int fd = channel->fd();
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, fd, channel->events(), index);
+
+    if (index == kNew)
+    {
+        addChannel(channel);
+    }
+    channel->set_index(kAdded);
+
+    FdState &state = stateOf(fd);
+    if (channel->isNoneEvent())
+    {
+        disarm(fd, state);
+        channel->set_index(kDeleted);
+        return;
+    }
+
+    bool multishot = channel->edgeTriggered() && multishotSupported_;
+    if (state.armedEvents == channel->events() && state.multishot == multishot)
+    {
+        return; // 内核里挂着的请求就是想要的 不用改
+    }
+    disarm(fd, state);
+    arm(fd, state, channel);
+}
+
+void IoUringPoller::removeChannel(Channel *channel)
+{
+    int fd = channel->fd();
+    eraseChannel(fd);
+
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, fd);
+
+    FdState &state = stateOf(fd);
+    disarm(fd, state);
+    state.needRearm = false;
+    channel->set_index(kNew);
+}
+
+IoUringPoller::FdState& IoUringPoller::stateOf(int fd)
+{
+    if (static_cast<size_t>(fd) >= fdStates_.size())
+    {
+        fdStates_.resize(std::max(static_cast<size_t>(fd) + 1, fdStates_.size() * 2));
+    }
+    return fdStates_[fd];
+}
+
+void IoUringPoller::arm(int fd, FdState &state, Channel *channel)
+{
+    io_uring_sqe *sqe = getSqe();
+    countCtl();
+    ++state.generation;
+    state.armedEvents = channel->events();
+    state.multishot = channel->edgeTriggered() && multishotSupported_;
+    state.needRearm = false;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    // 小端机器上poll32_events就是poll(2)的事件掩码 EPOLLIN/EPOLLOUT/EPOLLRDHUP和POLL*的取值相同
+    sqe->poll32_events = static_cast<uint32_t>(state.armedEvents);
+    sqe->len = state.multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = makeUserData(fd, state.generation);
+}
+
+void IoUringPoller::disarm(int fd, FdState &state)
+{
+    if (state.armedEvents != 0)
+    {
+        io_uring_sqe *sqe = getSqe();
+        countCtl();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = makeUserData(fd, state.generation);
+        sqe->user_data = kIgnoredUserData;
+        state.armedEvents = 0;
+    }
+    // 被撤掉的请求还可能有完成事件在路上 generation变了就会被丢弃
+    ++state.generation;
+}
+
+void IoUringPoller::rearmPending()
+{
+    for (int fd : rearmFds_)
+    {
+        FdState &state = fdStates_[fd];
+        if (!state.needRearm)
+        {
+            continue;
+        }
+        state.needRearm = false;
+        Channel *channel = findChannel(fd);
+        if (channel == nullptr)
+        {
+            continue;
+        }
+        // 处理事件的时候已经updateChannel重新挂过 或者已经不关心任何事件了
+        if (state.armedEvents != 0 || channel->isNoneEvent())
+        {
+            continue;
+        }
+        arm(fd, state, channel);
+    }
+    rearmFds_.clear();
+}
+
+io_uring_sqe* IoUringPoller::getSqe()
+{
+    unsigned tail = *sqTail_;
+    if (tail - loadAcquire(sqHead_) >= *sqEntries_)
+    {
+        // SQ满了先提交一批 没有SQPOLL的时候内核在io_uring_enter里同步取走请求
+        enter(0, 0);
+        if (tail - loadAcquire(sqHead_) >= *sqEntries_)
+        {
+            LOG_FATAL("io_uring submission queue full errno:%d \n", errno);
+        }
+    }
+    unsigned index = tail & *sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof *sqe);
+    sqArray_[index] = index;
+    // 内核只在io_uring_enter的时候读SQ 先移动tail再填内容也没问题
+    storeRelease(sqTail_, tail + 1);
+    ++toSubmit_;
+    return sqe;
+}
+
+int IoUringPoller::enter(unsigned waitNr, int timeoutMs)
+{
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    void *argp = nullptr;
+    size_t argSize = 0;
+
+    if (waitNr > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        memset(&arg, 0, sizeof arg);
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000 * 1000;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        argp = &arg;
+        argSize = sizeof arg;
+    }
+    else if (__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    int ret = ioUringEnter(ringFd_, toSubmit_, waitNr, flags, argp, argSize);
+    int saveErrno = errno;
+    // 不管成功失败 以内核实际取走的位置为准
+    toSubmit_ = *sqTail_ - loadAcquire(sqHead_);
+    errno = saveErrno;
+    return ret;
+}
+
+int IoUringPoller::reapCompletions()
+{
+    int count = 0;
+    unsigned head = *cqHead_;
+    unsigned tail;
+    while ((tail = loadAcquire(cqTail_)) != head)
+    {
+        for (; head != tail; ++head, ++count)
+        {
+            const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+            if (cqe.user_data == kIgnoredUserData)
+            {
+                continue;
+            }
+            int fd = static_cast<int>(cqe.user_data >> 32);
+            uint32_t generation = static_cast<uint32_t>(cqe.user_data);
+            if (static_cast<size_t>(fd) >= fdStates_.size() || fdStates_[fd].generation != generation)
+            {
+                continue; // channel改过或者删掉了 旧请求的事件
+            }
+
+            FdState &state = fdStates_[fd];
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+            {
+                // 单次poll触发了 或者multishot被内核终止了 请求已经不在内核里
+                state.armedEvents = 0;
+                if (!state.needRearm)
+                {
+                    state.needRearm = true;
+                    rearmFds_.push_back(fd);
+                }
+            }
+
+            int revents = 0;
+            if (cqe.res < 0)
+            {
+                if (cqe.res == -ECANCELED)
+                {
+                    continue;
+                }
+                revents = POLLERR;
+            }
+            else
+            {
+                revents = cqe.res;
+            }
+
+            state.revents |= revents;
+            if (!state.active)
+            {
+                state.active = true;
+                activeFds_.push_back(fd);
+            }
+        }
+        storeRelease(cqHead_, head);
+    }
+    return count;
+}
+
+void IoUringPoller::fillActiveChannels(ChannelList *activeChannels)
+{
+    for (int fd : activeFds_)
+    {
+        FdState &state = fdStates_[fd];
+        Channel *channel = findChannel(fd);
+        if (channel)
+        {
+            channel->set_revents(state.revents);
+            activeChannels->push_back(channel);
+        }
+        state.revents = 0;
+        state.active = false;
+    }
+    activeFds_.clear();
+}
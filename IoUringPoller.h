@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <linux/io_uring.h>
+
+#include <stdint.h>
+#include <vector>
+
+class Channel;
+
+/**
+ * io_uring的使用 不依赖liburing 直接用io_uring_setup/io_uring_enter系统调用和mmap出来的环
+ * 每个channel对应一个IORING_OP_POLL_ADD请求，和epoll的语义保持一致：
+ *  水平触发的channel用单次poll，事件处理完以后在下一次poll之前重新挂上去，
+ *      重新挂的时候内核会立刻检查一次就绪状态，所以数据没读完下一轮还会收到事件
+ *  边缘触发的channel用multishot poll(IORING_POLL_ADD_MULTI)，挂一次以后一直产生事件，
+ *      内核不支持multishot的时候edgeTriggeredSupported返回false 连接都退回水平触发
+ *
+ * 一轮里所有的挂poll/撤poll请求都先写进SQ，和等待事件合并成一次io_uring_enter
+ * 连接数很多、每轮活跃的连接又不多的时候，比epoll_ctl+epoll_wait少很多系统调用
+ *
+ * 请求的user_data = fd << 32 | generation，channel修改或者删除的时候generation加一，
+ * 旧请求的完成事件(包括被撤掉时的-ECANCELED)对不上generation直接丢弃，fd被复用也不会串
+*/
+class IoUringPoller : public Poller
+{
+public:
+    // 内核不支持io_uring(或者被禁用)时返回nullptr 由newDefaultPoller退回epoll
+    static IoUringPoller* newIoUringPoller(EventLoop *loop);
+    ~IoUringPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+    // 没有multishot poll的内核 边沿触发的channel也只能用单次poll
+    bool edgeTriggeredSupported() const override {return multishotSupported_;}
+    EventLoop::PollerType type() const override {return EventLoop::kIoUring;}
+
+private:
+    static const unsigned kSqEntries = 256;
+    static const unsigned kCqEntries = 4096;
+    static const uint64_t kIgnoredUserData = ~static_cast<uint64_t>(0);
+    static const uint64_t kProbeUserData = kIgnoredUserData - 1;
+
+    // 每个fd在内核里挂着的poll请求
+    struct FdState
+    {
+        FdState() : generation(0), armedEvents(0), multishot(false), needRearm(false), revents(0), active(false) {}
+        uint32_t generation;
+        int armedEvents; // 0表示当前没有挂poll
+        bool multishot;
+        bool needRearm; // 单次poll已经触发 或者multishot被内核终止了 等待下一轮重新挂
+        int revents; // 本轮收集到的事件 multishot一轮里可能触发多次
+        bool active; // 本轮已经记到activeFds_里了
+    };
+
+    explicit IoUringPoller(EventLoop *loop);
+    // 建环 成功返回true
+    bool init();
+    bool probeMultishot();
+
+    FdState& stateOf(int fd);
+    void arm(int fd, FdState &state, Channel *channel);
+    void disarm(int fd, FdState &state);
+    // 重新挂上一轮触发过的单次poll
+    void rearmPending();
+
+    io_uring_sqe* getSqe();
+    // 提交SQ里的请求 waitNr>0的时候等待完成事件 timeoutMs<0表示一直等
+    int enter(unsigned waitNr, int timeoutMs);
+    // 处理CQ里所有的完成事件 返回处理的个数
+    int reapCompletions();
+    void fillActiveChannels(ChannelList *activeChannels);
+
+    int ringFd_;
+    unsigned features_;
+    bool multishotSupported_;
+
+    // mmap出来的三块内存
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqMask_;
+    unsigned *sqEntries_;
+    unsigned *sqFlags_;
+    unsigned *sqArray_;
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned *cqMask_;
+    io_uring_cqe *cqes_;
+
+    unsigned toSubmit_; // 已经写进SQ还没有提交给内核的请求数
+
+    std::vector<FdState> fdStates_;
+    std::vector<int> rearmFds_;
+    std::vector<int> activeFds_;
+};
@@ -0,0 +1,57 @@
+#include "LengthHeaderCodec.h"
+#include "Buffer.h"
+#include "TcpConnection.h"
+#include "Logger.h"
+
+#include <vector>
+#include <endian.h>
+
+const size_t LengthHeaderCodec::kHeaderLen;
+const size_t LengthHeaderCodec::kDefaultMaxFrameLength;
+
+void LengthHeaderCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime)
+{
+    // 一次可能收到多帧 也可能不够一帧，剩下的留在缓冲区里等下次
+    // 帧回调里可能已经关闭了连接 后面的数据就不再解析
+    while (conn->connected() && buf->readableBytes() >= kHeaderLen)
+    {
+        const int32_t len = buf->peekInt32();
+        if (len < 0 || static_cast<size_t>(len) > maxFrameLength_)
+        {
+            LOG_ERROR("LengthHeaderCodec::onMessage [%s] invalid frame length %d \n", conn->name().c_str(), len);
+            // shutdown只关写端 对端接着发的数据还会被当成帧解析，直接关掉连接
+            buf->retrieveAll();
+            conn->forceClose();
+            break;
+        }
+        if (buf->readableBytes() < kHeaderLen + len)
+        {
+            break;
+        }
+        buf->retrieve(kHeaderLen);
+        frameCallback_(conn, buf->peek(), len, receiveTime);
+        buf->retrieve(len);
+    }
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    if (!conn->connected())
+    {
+        buf->retrieveAll(); // 发不出去也和发送成功一样把buf清空 不能留下写了一半的长度头
+        return;
+    }
+    const int32_t len = static_cast<int32_t>(buf->readableBytes());
+    buf->prependInt32(len);
+    conn->send(buf); // 没发完的部分连同存储换进连接的输出缓冲区 跨线程也不拷贝
+}
+
+void LengthHeaderCodec::send(const TcpConnectionPtr &conn, const void *data, size_t len)
+{
+    const int32_t be32 = htobe32(static_cast<int32_t>(len));
+    std::vector<TcpConnection::Slice> slices;
+    slices.reserve(2);
+    slices.push_back(TcpConnection::Slice(&be32, kHeaderLen));
+    slices.push_back(TcpConnection::Slice(data, len));
+    conn->send(slices);
+}
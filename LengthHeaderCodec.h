@@ -0,0 +1,48 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Callbacks.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+
+class Buffer;
+
+/**
+ * 4字节网络字节序长度头 + 消息体 的分帧编解码
+ *
+ * 接收：把onMessage设成TcpConnection的MessageCallback，输入缓冲区里每凑齐一整帧就回调一次FrameCallback，
+ *      data直接指向输入缓冲区里的消息体，不拷贝，只在回调期间有效
+ * 发送：send(conn, buf)把长度头写进buf前面预留的kCheapPrepend空间再整体发出去，
+ *      send(conn, data, len)把长度头和消息体作为两段一次writev发出去，两种都不需要把消息体拷到头后面
+ *
+ * 长度超过maxFrameLength(或者是负数)说明对端发的不是这个协议，记错误日志并强制关闭连接，缓冲区里剩下的数据丢掉
+*/
+class LengthHeaderCodec : noncopyable
+{
+public:
+    using FrameCallback = std::function<void (const TcpConnectionPtr&,
+                                              const char *data,
+                                              size_t len,
+                                              Timestamp)>;
+
+    static const size_t kHeaderLen = sizeof(int32_t);
+    static const size_t kDefaultMaxFrameLength = 64 * 1024 * 1024;
+
+    explicit LengthHeaderCodec(const FrameCallback &cb, size_t maxFrameLength = kDefaultMaxFrameLength)
+        : frameCallback_(cb)
+        , maxFrameLength_(maxFrameLength)
+    {}
+
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buf, Timestamp receiveTime);
+
+    // buf里是完整的消息体 发送以后buf被清空
+    void send(const TcpConnectionPtr &conn, Buffer *buf);
+    void send(const TcpConnectionPtr &conn, const void *data, size_t len);
+
+private:
+    FrameCallback frameCallback_;
+    const size_t maxFrameLength_;
+};
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "noncopyable.h"
+
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 无锁的多生产者单消费者队列 用来替代EventLoop里mutex + vector的pendingFunctors_
+ *
+ * 生产者用CAS把节点压到head_上(Treiber栈)，消费者用一次exchange把整条链表取走，
+ * 反转以后按push的顺序执行。消费者每次拿走的是当时已经在队列里的全部元素，
+ * 执行过程中新push进来的元素留到下一次consumeAll，这和原来swap vector的语义一致。
+ *
+ * push返回队列是否由空变为非空 消费者只有一个并且总是整体取走，所以不存在ABA问题
+ *
+ * 节点是复用的，稳定运行以后push不再分配内存：
+ *  消费者执行完一批以后把整条链表用一次CAS还到free_上，
+ *  生产者先从自己线程的缓存里拿节点，缓存空了再用一次exchange把free_整个取过来
+ *  free_上也只有整体取走，没有单个节点的pop，同样没有ABA问题
+ * 线程缓存按T共用，从一个队列取来的节点可以push到另一个队列里，线程退出时释放
+ * 两级空闲链表都有上限(free_大约kMaxFreeNodes个，线程缓存kMaxCachedNodes个)，
+ * 一次突发用掉的节点超出上限的部分直接释放，不会一直占着
+ * T本身的内存(比如std::function装不下的大闭包)不在这里管
+*/
+template <typename T>
+class MpscQueue : noncopyable
+{
+public:
+    MpscQueue()
+        : head_(nullptr)
+        , free_(nullptr)
+        , freeCount_(0)
+    {}
+
+    ~MpscQueue()
+    {
+        deleteList(head_.exchange(nullptr, std::memory_order_acquire));
+        deleteList(free_.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    // 可以在任意线程中调用 返回true说明push之前队列是空的
+    bool push(T value)
+    {
+        Node *node = allocNode();
+        node->value = std::move(value);
+        Node *old = head_.load(std::memory_order_relaxed);
+        do
+        {
+            node->next = old;
+        } while (!head_.compare_exchange_weak(old, node,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+        return old == nullptr;
+    }
+
+    // 只能在消费者线程中调用 按push的顺序对每个元素调用func，返回处理的个数
+    template <typename Func>
+    size_t consumeAll(Func &&func)
+    {
+        Node *node = head_.exchange(nullptr, std::memory_order_acquire);
+
+        // head_上是后进先出的顺序 先反转成先进先出
+        Node *ordered = nullptr;
+        while (node)
+        {
+            Node *next = node->next;
+            node->next = ordered;
+            ordered = node;
+            node = next;
+        }
+
+        // free_上已经够多了 这一批执行完直接释放
+        const bool recycle = freeCount_.load(std::memory_order_relaxed) < static_cast<int64_t>(kMaxFreeNodes);
+        size_t count = 0;
+        Node *first = ordered;
+        Node *last = nullptr;
+        while (ordered)
+        {
+            Node *next = ordered->next;
+            func(ordered->value);
+            if (recycle)
+            {
+                ordered->value = T(); // 闭包里捕获的对象现在就释放 不能跟着节点留在free_上
+                last = ordered;
+            }
+            else
+            {
+                delete ordered;
+            }
+            ordered = next;
+            ++count;
+        }
+
+        // 整条链表一次还回去
+        if (recycle && last)
+        {
+            Node *old = free_.load(std::memory_order_relaxed);
+            do
+            {
+                last->next = old;
+            } while (!free_.compare_exchange_weak(old, first,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed));
+            freeCount_.fetch_add(static_cast<int64_t>(count), std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    bool empty() const {return head_.load(std::memory_order_relaxed) == nullptr;}
+
+private:
+    static const size_t kMaxFreeNodes = 4096;
+    static const size_t kMaxCachedNodes = 1024;
+
+    struct Node
+    {
+        Node() : value(), next(nullptr) {}
+
+        T value;
+        Node *next;
+    };
+
+    // 每个线程自己的空闲节点 只有本线程访问
+    struct NodeCache
+    {
+        NodeCache() : head(nullptr) {}
+        ~NodeCache() {deleteList(head);}
+
+        Node *head;
+    };
+
+    static NodeCache& localCache()
+    {
+        static thread_local NodeCache cache;
+        return cache;
+    }
+
+    static void deleteList(Node *node)
+    {
+        while (node)
+        {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    Node* allocNode()
+    {
+        NodeCache &cache = localCache();
+        if (cache.head == nullptr)
+        {
+            Node *list = free_.exchange(nullptr, std::memory_order_acquire);
+            if (list == nullptr)
+            {
+                return new Node();
+            }
+            // 线程缓存最多留kMaxCachedNodes个 多出来的释放掉
+            int64_t taken = 0;
+            Node *tail = nullptr;
+            for (Node *n = list; n != nullptr && taken < static_cast<int64_t>(kMaxCachedNodes); n = n->next)
+            {
+                tail = n;
+                ++taken;
+            }
+            Node *rest = tail->next;
+            tail->next = nullptr;
+            while (rest)
+            {
+                Node *next = rest->next;
+                delete rest;
+                rest = next;
+                ++taken;
+            }
+            // 消费者是先还链表再加计数的 这里可能暂时减成负数
+            freeCount_.fetch_sub(taken, std::memory_order_relaxed);
+            cache.head = list;
+        }
+        Node *node = cache.head;
+        cache.head = node->next;
+        return node;
+    }
+
+    std::atomic<Node*> head_;
+    std::atomic<Node*> free_; // 执行完的节点 等生产者取走复用
+    std::atomic<int64_t> freeCount_; // free_上大约有多少个节点
+};
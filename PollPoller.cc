@@ -0,0 +1,110 @@
+#include "PollPoller.h"
+#include "Logger.h"
+#include "Channel.h"
+
+#include <algorithm>
+
+#include <errno.h>
+
+PollPoller::PollPoller(EventLoop* loop)
+    : Poller(loop)
+{
+}
+
+PollPoller::~PollPoller() = default;
+
+Timestamp PollPoller::poll(int timeoutMs, ChannelList *activeChannels)
+{
+    LOG_DEBUG("func=%s => fd total count:%lu \n", __FUNCTION__, numChannels_);
+
+    int numEvents = ::poll(pollfds_.data(), pollfds_.size(), timeoutMs);
+    int saveErrno = errno;
+    Timestamp now(Timestamp::now());
+
+    if (numEvents > 0)
+    {
+        LOG_DEBUG("%d events happen \n", numEvents);
+        fillActiveChannels(numEvents, activeChannels);
+    } else if (numEvents == 0)
+    {
+        LOG_DEBUG("%s timeout! \n", __FUNCTION__);
+    } else {
+        if (saveErrno != EINTR)
+        {
+            errno = saveErrno;
+            LOG_ERROR("PollPoller::poll() err!");
+        }
+    }
+    return now;
+}
+
+void PollPoller::fillActiveChannels(int numEvents, ChannelList *activeChannels) const
+{
+    for (PollFdList::const_iterator pfd = pollfds_.begin(); pfd != pollfds_.end() && numEvents > 0; ++pfd)
+    {
+        if (pfd->revents > 0)
+        {
+            --numEvents;
+            Channel *channel = findChannel(pfd->fd);
+            channel->set_revents(pfd->revents);
+            activeChannels->push_back(channel);
+        }
+    }
+}
+
+/**
+ * index_ < 0 说明是新的channel 追加到pollfds_最后
+ * 已经添加过的channel直接改pollfd的events 不关心任何事件的时候把fd改成负数，poll会跳过它
+*/
+void PollPoller::updateChannel(Channel *channel)
+{
+    LOG_DEBUG("func=%s => fd=%d events=%d index=%d \n", __FUNCTION__, channel->fd(), channel->events(), channel->index());
+
+    if (channel->index() < 0)
+    {
+        struct pollfd pfd;
+        pfd.fd = channel->fd();
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+        pollfds_.push_back(pfd);
+        channel->set_index(static_cast<int>(pollfds_.size()) - 1);
+        addChannel(channel);
+    }
+    else
+    {
+        struct pollfd &pfd = pollfds_[channel->index()];
+        pfd.fd = channel->fd();
+        pfd.events = static_cast<short>(channel->events());
+        pfd.revents = 0;
+        if (channel->isNoneEvent())
+        {
+            // -fd-1 保证0号fd也能变成负数
+            pfd.fd = -channel->fd() - 1;
+        }
+    }
+}
+
+void PollPoller::removeChannel(Channel *channel)
+{
+    LOG_DEBUG("func=%s => fd=%d\n", __FUNCTION__, channel->fd());
+
+    int idx = channel->index();
+    if (idx < 0)
+    {
+        return;
+    }
+    eraseChannel(channel->fd());
+    if (static_cast<size_t>(idx) != pollfds_.size() - 1)
+    {
+        // 和最后一个交换 被换过来的channel要更新下标
+        int lastFd = pollfds_.back().fd;
+        std::iter_swap(pollfds_.begin() + idx, pollfds_.end() - 1);
+        if (lastFd < 0)
+        {
+            lastFd = -lastFd - 1;
+        }
+        findChannel(lastFd)->set_index(idx);
+    }
+    pollfds_.pop_back();
+    channel->set_index(-1);
+}
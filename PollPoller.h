@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Poller.h"
+#include "Timestamp.h"
+
+#include <vector>
+#include <poll.h>
+
+class Channel;
+
+/**
+ * poll的使用
+ * 所有关心的fd放在一个pollfd数组里 每次poll把整个数组交给内核
+ * 没有epoll_ctl这样的修改系统调用 但是每次poll的开销和注册的fd总数成正比
+ *
+ * channel的index_是它在pollfds_中的下标，删除的时候和最后一个交换，数组保持紧凑
+ * poll没有边沿触发，channel的edgeTriggered被忽略
+*/
+class PollPoller : public Poller
+{
+public:
+    PollPoller(EventLoop* loop);
+    ~PollPoller() override;
+
+    Timestamp poll(int timeoutMs, ChannelList* activeChannels) override;
+    void updateChannel(Channel* channel) override;
+    void removeChannel(Channel* channel) override;
+    bool edgeTriggeredSupported() const override {return false;}
+    EventLoop::PollerType type() const override {return EventLoop::kPoll;}
+
+private:
+    void fillActiveChannels(int numEvents, ChannelList *activeChannels) const;
+
+    using PollFdList = std::vector<struct pollfd>;
+    PollFdList pollfds_;
+};
@@ -1,10 +1,39 @@
 #include "Poller.h"
 #include "Channel.h"
 
+#include <algorithm>
+
 Poller::Poller(EventLoop* loop)
-        : ownerLoop_(loop){}
+        : numChannels_(0), ctlCalls_(0), ownerLoop_(loop){}
 
 bool Poller::hasChannel(Channel* channel) const{
-    auto it = channels_.find(channel -> fd()); //it是ChannelMap::const_iterator迭代器
-    return it != channels_.end() && it -> second == channel;
-}
\ No newline at end of file
+    return findChannel(channel -> fd()) == channel;
+}
+
+Poller::ChannelEntry& Poller::channelEntry(int fd){
+    if (static_cast<size_t>(fd) >= channels_.size())
+    {
+        //按倍数扩容 连接数上涨的时候不会频繁搬移
+        channels_.resize(std::max(static_cast<size_t>(fd) + 1, std::max<size_t>(channels_.size() * 2, 64)));
+    }
+    return channels_[fd];
+}
+
+void Poller::addChannel(Channel* channel){
+    ChannelEntry &entry = channelEntry(channel -> fd());
+    if (entry.channel == nullptr)
+    {
+        ++numChannels_;
+    }
+    entry.channel = channel;
+    entry.registeredEvents = 0;
+}
+
+void Poller::eraseChannel(int fd){
+    if (static_cast<size_t>(fd) < channels_.size() && channels_[fd].channel)
+    {
+        channels_[fd].channel = nullptr;
+        channels_[fd].registeredEvents = 0;
+        --numChannels_;
+    }
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <unordered_map>
+#include <atomic>
 #include <vector>
 
 #include "Timestamp.h"
@@ -26,16 +26,43 @@ class Poller: noncopyable
     virtual void updateChannel(Channel* channel) = 0; //=0纯虚函数 必须被覆盖
     //remove the channel, when it destructs.Must be called in the loop thread.
     virtual void removeChannel(Channel* channel) = 0;
+    //能不能按边沿触发通知 不支持的时候TcpConnection退回水平触发
+    virtual bool edgeTriggeredSupported() const {return true;}
+    //实际使用的实现 不会是kDefault
+    virtual EventLoop::PollerType type() const = 0;
     //判断参数channel是否在当前Poller当中
     bool hasChannel(Channel* channel) const;
+    //当前注册的channel个数
+    size_t numChannels() const {return numChannels_;}
+    //真正提交给内核的兴趣事件修改次数(epoll_ctl/io_uring的poll请求) 只由loop线程写 任意线程都可以读
+    int64_t ctlCalls() const {return ctlCalls_.load(std::memory_order_relaxed);}
 
     //EventLoop可以通过该接口获取默认的IO复用的具体实现
-    static Poller* newDefaultPoller(EventLoop* loop);
+    static Poller* newDefaultPoller(EventLoop* loop, EventLoop::PollerType type = EventLoop::kDefault);
 
     protected:
-    //map的key：sockfd，value：socketfd所属的channel通道类型
-    using ChannelMap = std::unordered_map <int, Channel*>;
+    //fd是从小到大分配的稠密整数 直接用fd做下标 查找不需要hash
+    struct ChannelEntry
+    {
+        ChannelEntry() : channel(nullptr), registeredEvents(0) {}
+        Channel* channel;
+        int registeredEvents; //已经注册到内核里的事件(包括EPOLLET) 0表示没有注册 和它相同的修改可以直接跳过
+    };
+    //fd超出表的大小时自动扩容
+    ChannelEntry& channelEntry(int fd);
+    Channel* findChannel(int fd) const
+    {
+        return static_cast<size_t>(fd) < channels_.size() ? channels_[fd].channel : nullptr;
+    }
+    void addChannel(Channel* channel);
+    void eraseChannel(int fd);
+    void countCtl() {ctlCalls_.store(ctlCalls_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);}
+
+    //下标：sockfd，值：socketfd所属的channel通道以及注册的事件
+    using ChannelMap = std::vector<ChannelEntry>;
     ChannelMap channels_;
+    size_t numChannels_;
+    std::atomic<int64_t> ctlCalls_;
     
     private:
     EventLoop* ownerLoop_; // 定义poller所属的事件循环EventLoop
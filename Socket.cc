@@ -79,6 +79,18 @@ void Socket::setKeepAlive(bool on)
     ::setsockopt(sockfd_, SOL_SOCKET, SO_KEEPALIVE, &optval, sizeof optval);
 }
 
+bool Socket::setZeroCopy(bool on)
+{
+    int optval = on ? 1: 0;
+    return ::setsockopt(sockfd_, SOL_SOCKET, SO_ZEROCOPY, &optval, sizeof optval) == 0;
+}
+
+void Socket::setTcpCork(bool on)
+{
+    int optval = on ? 1: 0;
+    ::setsockopt(sockfd_, IPPROTO_TCP, TCP_CORK, &optval, sizeof optval);
+}
+
 /**
  * TCP_NODELAY (setTcpNoDelay() method): This option is used to control the Nagle's algorithm for a TCP socket. When this option is enabled (set to 1), 
  * the algorithm is disabled, and small packets are sent immediately without waiting for the buffer to fill up or an 
@@ -94,6 +106,9 @@ SO_REUSEPORT (setReusePort() method): This option allows multiple sockets to bin
 with the operating system distributing incoming connections among the bound sockets. This can be helpful for load balancing a
 nd enables multiple processes or threads to share the same port, improving performance.
 
+TCP_CORK (setTcpCork() method): While this option is set, the kernel does not send partial frames. Data is queued until
+a full segment can be sent or the option is cleared, which makes a header written separately from its body go out in the same packet.
+
 SO_KEEPALIVE (setKeepAlive() method): This option enables the periodic transmission of keep-alive probes for a TCP connection 
 when there is no data exchanged for a specified amount of time. If the remote endpoint does not respond to the keep-alive probes, t
 he connection is considered broken and will be closed. Enabling this option can help detect broken connections and free up resources in a more timely manner.
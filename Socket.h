@@ -25,6 +25,8 @@ public:
     void setReuseAddr(bool on); // 设置地址重用 
     void setReusePort(bool on); // 设置端口重用 
     void setKeepAlive(bool on); // 设置保活 
+    bool setZeroCopy(bool on); // 允许MSG_ZEROCOPY 内核不支持返回false
+    void setTcpCork(bool on); // 打开以后不满一个MSS的数据先攒着 关闭的时候立刻发出去
 
 private:
     const int sockfd_;
@@ -0,0 +1,181 @@
+#include "TcpClient.h"
+#include "EventLoop.h"
+#include "Logger.h"
+
+#include <sys/socket.h>
+#include <strings.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <functional>
+
+static EventLoop* checkLoopNotNull(EventLoop *loop)
+{
+    if (loop == nullptr)
+    {
+        LOG_FATAL("%s:%s:%d client loop is null!\n", __FILE__, __FUNCTION__, __LINE__);
+    }
+    return loop;
+}
+
+void TcpClient::newConnectionGuarded(const GuardPtr &guard, int sockfd)
+{
+    std::lock_guard<std::recursive_mutex> lock(guard->mutex);
+    if (guard->client)
+    {
+        guard->client->newConnection(sockfd);
+    }
+    else
+    {
+        ::close(sockfd); // TcpClient已经析构了 连上了也没人要
+    }
+}
+
+void TcpClient::removeConnectionGuarded(const GuardPtr &guard, EventLoop *loop, const TcpConnectionPtr &conn)
+{
+    std::lock_guard<std::recursive_mutex> lock(guard->mutex);
+    if (guard->client)
+    {
+        guard->client->removeConnection(conn);
+    }
+    else
+    {
+        // TcpClient析构以后还没关掉的连接 只销毁连接，不能再回调到TcpClient
+        loop->queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    }
+}
+
+TcpClient::TcpClient(EventLoop *loop,
+                        const InetAddress &serverAddr,
+                        const std::string &nameArg)
+                        : loop_(checkLoopNotNull(loop))
+                        , connector_(new Connector(loop, serverAddr))
+                        , name_(nameArg)
+                        , connectionCallback_()
+                        , messageCallback_()
+                        , retry_(false)
+                        , connect_(false)
+                        , nextConnId_(1)
+                        , edgeTriggered_(false)
+                        , chunkedOutputBuffer_(false)
+                        , autoCork_(false)
+                        , flowHighWaterMark_(0)
+                        , flowLowWaterMark_(0)
+                        , guard_(std::make_shared<Guard>())
+{
+    guard_->client = this;
+    connector_->setNewConnectionCallback(std::bind(&TcpClient::newConnectionGuarded, guard_, std::placeholders::_1));
+}
+
+TcpClient::~TcpClient()
+{
+    {
+        // 置空以后loop线程里的回调都不会再调用this 正在执行的回调会先执行完
+        std::lock_guard<std::recursive_mutex> lock(guard_->mutex);
+        guard_->client = nullptr;
+    }
+    TcpConnectionPtr conn;
+    bool unique = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unique = connection_.unique();
+        conn = connection_;
+    }
+    // 连接可能比TcpClient活得久(比如用户还拿着它) 用户不拿着就关掉
+    if (conn && unique)
+    {
+        conn->forceClose();
+    }
+    connector_->stop();
+}
+
+void TcpClient::connect()
+{
+    LOG_INFO("TcpClient::connect [%s] - connecting to %s \n",
+        name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+    connect_ = true;
+    connector_->start();
+}
+
+void TcpClient::disconnect()
+{
+    connect_ = false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connection_)
+    {
+        connection_->shutdown();
+    }
+}
+
+void TcpClient::stop()
+{
+    connect_ = false;
+    connector_->stop();
+}
+
+void TcpClient::newConnection(int sockfd)
+{
+    sockaddr_in peer;
+    sockaddr_in local;
+    ::bzero(&peer, sizeof peer);
+    ::bzero(&local, sizeof local);
+    socklen_t addrlen = sizeof peer;
+    if (::getpeername(sockfd, (sockaddr*)&peer, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getPeerAddr");
+    }
+    addrlen = sizeof local;
+    if (::getsockname(sockfd, (sockaddr*)&local, &addrlen) < 0)
+    {
+        LOG_ERROR("sockets::getLocalAddr");
+    }
+    InetAddress peerAddr(peer);
+    InetAddress localAddr(local);
+
+    char buf[64] = {0};
+    snprintf(buf, sizeof buf, "-%s#%d", peerAddr.toIpPort().c_str(), nextConnId_);
+    ++nextConnId_;
+    std::string connName = name_ + buf;
+
+    LOG_INFO("TcpClient::newConnection [%s] - new Connection [%s] from %s \n",
+        name_.c_str(), connName.c_str(), localAddr.toIpPort().c_str());
+
+    TcpConnectionPtr conn(new TcpConnection(
+                            loop_,
+                            connName,
+                            sockfd,
+                            localAddr,
+                            peerAddr));
+    conn -> setConnectionCallback(connectionCallback_);
+    conn -> setMessageCallback(messageCallback_);
+    conn -> setWriteCompleteCallback(writeCompleteCallback_);
+    conn -> setEdgeTriggered(edgeTriggered_);
+    conn -> setChunkedOutputBuffer(chunkedOutputBuffer_);
+    conn -> setAutoCork(autoCork_);
+    conn -> setFlowControl(flowHighWaterMark_, flowLowWaterMark_);
+    conn -> setCloseCallback(std::bind(&TcpClient::removeConnectionGuarded, guard_, loop_, std::placeholders::_1));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connection_ = conn;
+    }
+    // 已经在loop线程里了
+    conn -> connectEstablished();
+}
+
+void TcpClient::removeConnection(const TcpConnectionPtr &conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (connection_ == conn)
+        {
+            connection_.reset();
+        }
+    }
+
+    loop_ -> queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
+    if (retry_ && connect_)
+    {
+        LOG_INFO("TcpClient::removeConnection [%s] - reconnecting to %s \n",
+            name_.c_str(), connector_->serverAddress().toIpPort().c_str());
+        connector_->restart();
+    }
+}
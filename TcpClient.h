@@ -0,0 +1,98 @@
+#pragma once
+
+/**
+ * 用户使用muduo编写客户端程序
+ * 连上以后得到的是和服务端一样的TcpConnection，回调的类型也一样，收发数据的代码可以两边共用
+*/
+#include "noncopyable.h"
+#include "InetAddress.h"
+#include "Callbacks.h"
+#include "TcpConnection.h"
+#include "Connector.h"
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+class EventLoop;
+
+// 一个TcpClient管理到serverAddr的一条连接，连接和重连都在loop里完成
+// 要大量的出站连接就建多个TcpClient，loop可以直接用TcpServer线程池里的loop，和入站连接一起复用同一批线程
+class TcpClient : noncopyable
+{
+public:
+    TcpClient(EventLoop *loop,
+                const InetAddress &serverAddr,
+                const std::string &nameArg);
+    ~TcpClient();
+
+    void connect(); // 线程安全 连不上按指数退避重试，直到连上或者stop
+    void disconnect(); // 线程安全 关闭已经建立的连接(等输出队列发完)
+    void stop(); // 线程安全 停止还没有连上的连接和重试
+
+    EventLoop* getLoop() const {return loop_;}
+    const std::string& name() const {return name_;}
+    // 线程安全 还没连上或者已经断开返回空
+    TcpConnectionPtr connection() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return connection_;
+    }
+
+    // 连接断开以后自动重新连接 默认不重连 重连也按退避间隔(带抖动)等一会再连
+    bool retry() const {return retry_;}
+    void enableRetry() {retry_ = true;}
+    // 重连的退避间隔 从initSeconds开始每次翻倍最多maxSeconds 在connect之前设置
+    void setRetryDelay(double initSeconds, double maxSeconds) {connector_->setRetryDelay(initSeconds, maxSeconds);}
+
+    // 回调和TcpServer一样 在connect之前设置，非线程安全
+    void setConnectionCallback(const ConnectionCallback &cb) {connectionCallback_ = cb;}
+    void setMessageCallback(const MessageCallback &cb) {messageCallback_ = cb;}
+    void setWriteCompleteCallback(const WriteCompleteCallback &cb) {writeCompleteCallback_ = cb;}
+
+    // 连接的选项 含义见TcpServer的同名函数
+    void setEdgeTriggered(bool on) {edgeTriggered_ = on;}
+    void setChunkedOutputBuffer(bool on) {chunkedOutputBuffer_ = on;}
+    void setAutoCork(bool on) {autoCork_ = on;}
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark)
+    {flowHighWaterMark_ = highWaterMark; flowLowWaterMark_ = lowWaterMark;}
+
+private:
+    // 在loop线程里 Connector连上以后调用
+    void newConnection(int sockfd);
+    // 在loop线程里 连接关闭的时候调用
+    void removeConnection(const TcpConnectionPtr &conn);
+
+    // Connector和TcpConnection的回调拿着guard而不是this，析构的时候在锁里把client置空，
+    // 之后在loop线程里到达的回调就不会再碰已经析构的TcpClient 用递归锁是因为newConnection里会调用用户的回调，用户可能在里面析构TcpClient
+    struct Guard
+    {
+        std::recursive_mutex mutex;
+        TcpClient *client;
+    };
+    using GuardPtr = std::shared_ptr<Guard>;
+    static void newConnectionGuarded(const GuardPtr &guard, int sockfd);
+    static void removeConnectionGuarded(const GuardPtr &guard, EventLoop *loop, const TcpConnectionPtr &conn);
+
+    EventLoop *loop_;
+    ConnectorPtr connector_;
+    const std::string name_;
+
+    ConnectionCallback connectionCallback_;
+    MessageCallback messageCallback_;
+    WriteCompleteCallback writeCompleteCallback_;
+
+    std::atomic_bool retry_;
+    std::atomic_bool connect_;
+    int nextConnId_; // 只在loop线程里访问
+    bool edgeTriggered_;
+    bool chunkedOutputBuffer_;
+    bool autoCork_;
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
+
+    mutable std::mutex mutex_;
+    TcpConnectionPtr connection_; // 用mutex_保护
+    GuardPtr guard_;
+};
@@ -3,15 +3,35 @@
 #include "Socket.h"
 #include "Channel.h"
 #include "EventLoop.h"
+#include "BufferPool.h"
 
 #include <functional>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <strings.h>
+#include <string.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <string>
+#include <algorithm>
+
+// ET模式下一次事件最多读/写这么多字节，剩下的放到本轮末尾继续，不让一个连接饿死其他连接
+static const size_t kMaxBytesPerEvent = 256 * 1024;
+// 一次writev最多的段数
+static const int kMaxIovecs = IOV_MAX;
+// 缓冲区占用超过这么多 而且是数据量的4倍以上才缩小 避免来回扩容缩容
+static const size_t kTrimMinBytes = 64 * 1024;
+// 连接关闭以后等待零拷贝完成通知 检查间隔从1ms开始翻倍 最长1s
+static const double kZeroCopyLingerInitDelay = 0.001;
+static const double kZeroCopyLingerMaxDelay = 1.0;
 
 // 采用静态编译 和其他文件的同名函数不会冲突
 static EventLoop* CheckLoopNotNull(EventLoop* loop)
@@ -32,11 +52,29 @@ TcpConnection::TcpConnection(EventLoop *loop,
       name_(nameArg),
       state_(kConnecting),
       reading_(true),
+      flowPaused_(false),
+      flowHighWaterMark_(0),
+      flowLowWaterMark_(0),
+      autoCork_(false),
+      corked_(false),
+      tcpCorked_(false),
+      flushQueued_(false),
+      edgeTriggered_(false),
       socket_(new Socket(sockfd)), 
       channel_(new Channel(loop, sockfd)),
       localAddr_(localAddr),
       peerAddr_(peerAddr),
-      highWaterMark_(64*1024*1024) // 64M
+      highWaterMark_(64*1024*1024), // 64M
+      inputBuffer_(0),
+      outputBuffer_(0),
+      queuedBytes_(0),
+      zeroCopy_(false),
+      zeroCopyThreshold_(kDefaultZeroCopyThreshold),
+      zeroCopyNextSeq_(0),
+      zeroCopyFirstSeq_(0),
+      idleTimeout_(0.0),
+      readTimeout_(0.0),
+      writeTimeout_(0.0)
       {
         // 下面给channel设置相应的回调函数，poller给channel通知感兴趣的事情发生了，channel会回调相应的操作函数
         channel_->setReadCallback(
@@ -51,6 +89,10 @@ TcpConnection::TcpConnection(EventLoop *loop,
         channel_->setErrorCallback(
             std::bind(&TcpConnection::handleError, this)
         );
+        // 连接关闭之前一定会cancelTimeouts 所以这里绑定this是安全的
+        idleEntry_.setCallback(std::bind(&TcpConnection::handleTimeout, this, "idle"));
+        readEntry_.setCallback(std::bind(&TcpConnection::handleTimeout, this, "read"));
+        writeEntry_.setCallback(std::bind(&TcpConnection::handleTimeout, this, "write"));
 
         LOG_INFO("TcpConnection::ctor[%s] at fd=%d\n", name_.c_str(), sockfd);
         socket_->setKeepAlive(true);
@@ -58,94 +100,797 @@ TcpConnection::TcpConnection(EventLoop *loop,
 
       TcpConnection::~TcpConnection()
       {
-        LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d \n", name_.c_str(), channel_->fd(), (int)state_);
+        const Buffer::ReadStats &reads = inputBuffer_.readStats();
+        LOG_INFO("TcpConnection::dtor[%s] at fd=%d state=%d reads=%ld bytes/read=%.1f scratch=%ld \n",
+                 name_.c_str(), channel_->fd(), (int)state_, reads.calls,
+                 reads.calls > 0 ? static_cast<double>(reads.bytes) / reads.calls : 0.0, reads.scratchBytes);
+        while (!outputQueue_.empty())
+        {
+            popOutputSegment(); // 没发完的文件在这里关掉dup出来的fd
+        }
+      }
+
+      void TcpConnection::setEdgeTriggered(bool on)
+      {
+        edgeTriggered_ = on && loop_->edgeTriggeredSupported();
+      }
+
+      void TcpConnection::setZeroCopy(bool on, size_t threshold)
+      {
+        zeroCopyThreshold_ = threshold;
+        if (on && !socket_->setZeroCopy(true))
+        {
+            LOG_INFO("TcpConnection::setZeroCopy [%s] SO_ZEROCOPY not supported errno=%d \n", name_.c_str(), errno);
+            on = false;
+        }
+        zeroCopy_ = on; // 关掉的时候不清SO_ZEROCOPY 还没收到的完成通知照样处理
       }
 
       void TcpConnection::send(const std::string &buf)
+      {
+        send(buf.data(), buf.size());
+      }
+
+      void TcpConnection::send(const void *message, size_t len)
       {
         if (state_==kConnected)
         {
 
                 if (loop_->isInLoopThread()){
-                    sendInLoop(buf.c_str(), buf.size()); // 这里我们传的是string而不是buffer，因此不用调用retriveAll()来重置读index的位置
+                    sendInLoop(message, len); // 这里我们传的是string而不是buffer，因此不用调用retriveAll()来重置读index的位置
                 }
                 else {
-                    loop_->runInLoop(
-                        std::bind(&TcpConnection::sendInLoop, this, buf.c_str(), buf.size())
-                    );
+                    // 调用返回以后message就可能失效 只能拷一份作为数据块交给loop线程
+                    send(std::make_shared<const std::string>(static_cast<const char*>(message), len));
+                }
+        }
+      }
+
+      void TcpConnection::send(std::string &&buf)
+      {
+        if (state_ == kConnected)
+        {
+            if (loop_->isInLoopThread())
+            {
+                sendInLoop(buf.data(), buf.size());
+            }
+            else
+            {
+                send(std::make_shared<const std::string>(std::move(buf)));
+            }
+        }
+      }
+
+      void TcpConnection::send(Buffer *buf)
+      {
+        if (state_ == kConnected)
+        {
+            if (loop_->isInLoopThread())
+            {
+                sendBufferInLoop(buf);
+            }
+            else
+            {
+                // 把数据连同底层存储一起换出来 调用方拿到一个空的Buffer
+                std::shared_ptr<Buffer> owned = std::make_shared<Buffer>(0);
+                owned->swapData(*buf);
+                loop_->runInLoop(
+                    std::bind(&TcpConnection::sendOwnedBufferInLoop, shared_from_this(), owned)
+                );
+            }
+        }
+      }
+
+      void TcpConnection::send(const std::vector<Slice> &slices)
+      {
+        if (state_ == kConnected)
+        {
+            if (loop_->isInLoopThread())
+            {
+                std::vector<struct iovec> vec(slices.size());
+                for (size_t i = 0; i < slices.size(); ++i)
+                {
+                    vec[i].iov_base = const_cast<void*>(slices[i].data);
+                    vec[i].iov_len = slices[i].len;
                 }
+                sendSlicesInLoop(vec.data(), static_cast<int>(vec.size()));
+            }
+            else
+            {
+                // slice只在调用期间有效 跨线程只能拼起来拷一份，作为数据块交给loop线程
+                std::shared_ptr<std::string> block = std::make_shared<std::string>();
+                for (const Slice &slice : slices)
+                {
+                    block->append(static_cast<const char*>(slice.data), slice.len);
+                }
+                send(BlockPtr(block));
+            }
         }
       }
 
-      /**
-       * 发送数据 应用写的快，而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置了水位回调
-      */
-     void TcpConnection::sendInLoop(const void* data, size_t len)
-     {
-        ssize_t nwrote = 0;
-        size_t remaining = len;
-        bool faultError = false;
+      void TcpConnection::send(const BlockPtr &block)
+      {
+        send(std::vector<BlockPtr>(1, block));
+      }
+
+      void TcpConnection::send(const std::vector<BlockPtr> &blocks)
+      {
+        if (state_ == kConnected)
+        {
+            if (loop_->isInLoopThread())
+            {
+                sendBlocksInLoop(blocks);
+            }
+            else
+            {
+                loop_->runInLoop(
+                    std::bind(&TcpConnection::sendBlocksInLoop, shared_from_this(), blocks)
+                );
+            }
+        }
+      }
+
+      void TcpConnection::sendFile(int fd, off_t offset, size_t length)
+      {
+        if (state_ == kConnected)
+        {
+            int dupFd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (dupFd < 0)
+            {
+                LOG_ERROR("TcpConnection::sendFile [%s] dup fd=%d failed errno=%d \n", name_.c_str(), fd, errno);
+                return;
+            }
+            if (loop_->isInLoopThread())
+            {
+                sendFileInLoop(dupFd, offset, length);
+            }
+            else
+            {
+                loop_->runInLoop(
+                    std::bind(&TcpConnection::sendFileInLoop, shared_from_this(), dupFd, offset, length)
+                );
+            }
+        }
+      }
+
+      /**
+       * 发送数据 应用写的快，而内核发送数据慢，需要把待发送数据写入缓冲区，而且设置了水位回调
+      */
+     void TcpConnection::sendInLoop(const void* data, size_t len)
+     {
+        struct iovec vec;
+        vec.iov_base = const_cast<void*>(data);
+        vec.iov_len = len;
+        sendSlicesInLoop(&vec, 1);
+     }
+
+     void TcpConnection::sendSlicesInLoop(const struct iovec *vec, int iovcnt)
+     {
+        // 之前调用过该connection的shutdown，不能再进行发送了
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing \n");
+            return;
+        }
+
+        ++stats_.messagesOut;
+        size_t total = 0;
+        for (int i = 0; i < iovcnt; ++i)
+        {
+            total += vec[i].iov_len;
+        }
+        size_t nwrote = 0;
+        bool faultError = false;
+        // 表示channel_第一次开始写数据，而且输出队列里没有待发送数据
+        // LT模式下队列为空的时候一定没有注册写事件；ET模式写事件一直注册着，只看队列
+        // 写合并的时候先排队 攒到flush的时候一起发
+        if (outputQueue_.empty() && !deferWrites())
+        {
+            nwrote = writeDirectly(vec, iovcnt, total, &faultError);
+        }
+
+        /**
+         *  说明大概先前这一次write，并没有把数据全部发送出去，剩余的数据需要保存到缓冲区中，然后给channel
+         * 注册epollout事件，poller发现tcp的发送缓冲区(不是当前的outputBuffer，而是系统自带的buffer)有空间，会通知相应的socket-channel, 调用writeCallback回调方法
+         * 也就是调用TcpConnection::handleWrite方法， handleWrite方法再判断outputBuffer是否全部发送，没有发送继续发送，直到把发送缓冲区的数据全部发送完毕
+        */
+        if (!faultError && nwrote < total)
+        {
+            size_t oldLen = queuedBytes_;
+            size_t skip = nwrote;
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                if (skip >= vec[i].iov_len)
+                {
+                    skip -= vec[i].iov_len;
+                    continue;
+                }
+                // slice的内存send返回以后就不归我们管了 没发出去的只能拷进outputBuffer_
+                enqueueBytes(static_cast<const char*>(vec[i].iov_base) + skip, vec[i].iov_len - skip);
+                skip = 0;
+            }
+            outputQueued(oldLen);
+        }
+     }
+
+     void TcpConnection::sendBlocksInLoop(const std::vector<BlockPtr> &blocks)
+     {
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing \n");
+            return;
+        }
+
+        ++stats_.messagesOut;
+        size_t total = 0;
+        for (const BlockPtr &block : blocks)
+        {
+            total += block->size();
+        }
+        if (zeroCopy_)
+        {
+            // 大块要走MSG_ZEROCOPY 全部按引用排队以后由writeOutputQueue决定哪些块零拷贝
+            size_t oldLen = queuedBytes_;
+            for (const BlockPtr &block : blocks)
+            {
+                if (!block->empty())
+                {
+                    enqueueBlock(block, 0);
+                }
+            }
+            startOutput(oldLen);
+            return;
+        }
+
+        size_t nwrote = 0;
+        bool faultError = false;
+        if (outputQueue_.empty() && !deferWrites())
+        {
+            std::vector<struct iovec> vec(blocks.size());
+            for (size_t i = 0; i < blocks.size(); ++i)
+            {
+                vec[i].iov_base = const_cast<char*>(blocks[i]->data());
+                vec[i].iov_len = blocks[i]->size();
+            }
+            nwrote = writeDirectly(vec.data(), static_cast<int>(vec.size()), total, &faultError);
+        }
+
+        if (!faultError && nwrote < total)
+        {
+            size_t oldLen = queuedBytes_;
+            size_t skip = nwrote;
+            for (const BlockPtr &block : blocks)
+            {
+                if (skip >= block->size())
+                {
+                    skip -= block->size();
+                    continue;
+                }
+                enqueueBlock(block, skip); // 剩下的部分继续引用应用的数据块
+                skip = 0;
+            }
+            outputQueued(oldLen);
+        }
+     }
+
+     void TcpConnection::sendBufferInLoop(Buffer *buf)
+     {
+        if (state_ == kDisconnected)
+        {
+            LOG_ERROR("disconnected, give up writing \n");
+            return;
+        }
+
+        size_t len = buf->readableBytes();
+        if (len == 0)
+        {
+            return;
+        }
+        struct iovec vec[kMaxIovecs];
+        if (outputBuffer_.readableBytes() == 0 && outputBuffer_.chunked() == buf->chunked())
+        {
+            ++stats_.messagesOut;
+            size_t nwrote = 0;
+            bool faultError = false;
+            if (outputQueue_.empty() && !deferWrites())
+            {
+                int iovcnt = buf->readableIovecs(0, len, vec, kMaxIovecs);
+                nwrote = writeDirectly(vec, iovcnt, len, &faultError);
+            }
+            if (!faultError && nwrote < len)
+            {
+                // outputBuffer_是空的 没发完的数据直接换进去，排在队列里已有的数据块后面
+                buf->retrieve(nwrote);
+                returnStorage(&outputBuffer_);
+                outputBuffer_.swapData(*buf);
+                size_t oldLen = queuedBytes_;
+                enqueueBuffered(len - nwrote);
+                outputQueued(oldLen);
+            }
+            buf->retrieveAll();
+            return;
+        }
+
+        // outputBuffer_里还有没发出去的数据 只能按顺序拷在后面
+        int64_t messagesOut = stats_.messagesOut;
+        size_t offset = 0;
+        while (offset < len && state_ != kDisconnected)
+        {
+            int iovcnt = buf->readableIovecs(offset, len - offset, vec, kMaxIovecs);
+            sendSlicesInLoop(vec, iovcnt);
+            for (int i = 0; i < iovcnt; ++i)
+            {
+                offset += vec[i].iov_len;
+            }
+        }
+        stats_.messagesOut = messagesOut + 1; // 超过kMaxIovecs块的时候分了几次 还是算一次send
+        buf->retrieveAll();
+     }
+
+     void TcpConnection::sendOwnedBufferInLoop(const std::shared_ptr<Buffer> &buf)
+     {
+        sendBufferInLoop(buf.get());
+     }
+
+     size_t TcpConnection::writeDirectly(const struct iovec *vec, int iovcnt, size_t total, bool *faultError)
+     {
+        ssize_t nwrote = iovcnt == 1 ? ::write(channel_->fd(), vec[0].iov_base, vec[0].iov_len)
+                                     : ::writev(channel_->fd(), vec, std::min(iovcnt, kMaxIovecs));
+        recordWrite(nwrote, errno);
+        if (nwrote >= 0)
+        {
+            idleEntry_.refresh();
+            if (static_cast<size_t>(nwrote) == total && writeCompleteCallback_)
+            {
+                // 既然在这里数据全部发送完毕，就不用在给channel设置epollout事件了 handleWrite的前提是输出队列中有待发送数据，而这里全部发送完毕了，也就不会往队列中写数据了
+                loop_->queueInLoop(
+                    std::bind(writeCompleteCallback_, shared_from_this())
+                );
+            }
+            return nwrote;
+        }
+        if (errno != EWOULDBLOCK)
+        {
+            LOG_ERROR("TcpConnection::sendInLoop \n");
+            if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET，客户端socket重置
+            {
+                *faultError = true;
+            }
+        }
+        return 0;
+     }
+
+     void TcpConnection::enqueueBytes(const char *data, size_t len)
+     {
+        if (!outputBuffer_.chunked() && !outputBuffer_.hasStorage())
+        {
+            borrowStorage(&outputBuffer_, len);
+        }
+        outputBuffer_.append(data, len);
+        enqueueBuffered(len);
+     }
+
+     void TcpConnection::enqueueBuffered(size_t len)
+     {
+        if (!outputQueue_.empty() && outputQueue_.back().kind == OutputSegment::kBuffered)
+        {
+            outputQueue_.back().len += len;
+        }
+        else
+        {
+            OutputSegment segment;
+            segment.kind = OutputSegment::kBuffered;
+            segment.fd = -1;
+            segment.offset = 0;
+            segment.len = len;
+            outputQueue_.push_back(segment);
+        }
+        queuedBytes_ += len;
+     }
+
+     void TcpConnection::enqueueBlock(const BlockPtr &block, size_t offset)
+     {
+        OutputSegment segment;
+        segment.kind = OutputSegment::kBlock;
+        segment.block = block;
+        segment.fd = -1;
+        segment.offset = offset;
+        segment.len = block->size() - offset;
+        outputQueue_.push_back(segment);
+        queuedBytes_ += segment.len;
+     }
+
+     void TcpConnection::sendFileInLoop(int fd, off_t offset, size_t length)
+     {
+        if (state_ == kDisconnected || length == 0)
+        {
+            if (state_ == kDisconnected)
+            {
+                LOG_ERROR("disconnected, give up writing \n");
+            }
+            ::close(fd);
+            return;
+        }
+
+        ++stats_.messagesOut;
+        OutputSegment segment;
+        segment.kind = OutputSegment::kFile;
+        segment.fd = fd;
+        segment.offset = offset;
+        segment.len = length;
+        size_t oldLen = queuedBytes_;
+        outputQueue_.push_back(segment);
+        queuedBytes_ += length;
+
+        startOutput(oldLen);
+     }
+
+     void TcpConnection::startOutput(size_t oldLen)
+     {
+        // 前面没有排队的数据 直接发一次 和send的第一次write一样
+        if (oldLen == 0 && queuedBytes_ > 0 && !deferWrites())
+        {
+            int savedErrno = 0;
+            ssize_t n = writeOutputQueue(&savedErrno);
+            if (n > 0)
+            {
+                idleEntry_.refresh();
+            }
+            else if (n < 0 && savedErrno != EWOULDBLOCK)
+            {
+                LOG_ERROR("TcpConnection::startOutput \n");
+            }
+            if (outputQueue_.empty())
+            {
+                checkFlowControl();
+                if (writeCompleteCallback_)
+                {
+                    loop_->queueInLoop(
+                        std::bind(writeCompleteCallback_, shared_from_this())
+                    );
+                }
+                return;
+            }
+        }
+        if (queuedBytes_ > oldLen)
+        {
+            outputQueued(oldLen);
+        }
+     }
+
+     void TcpConnection::popOutputSegment()
+     {
+        if (outputQueue_.front().kind == OutputSegment::kFile)
+        {
+            ::close(outputQueue_.front().fd);
+        }
+        outputQueue_.pop_front();
+     }
+
+     void TcpConnection::borrowStorage(Buffer *buf, size_t size)
+     {
+        std::vector<char> storage;
+        loop_->bufferPool()->acquire(Buffer::kCheapPrepend + size, &storage);
+        buf->adoptStorage(&storage);
+     }
+
+     void TcpConnection::returnStorage(Buffer *buf)
+     {
+        std::vector<char> storage;
+        if (buf->hasStorage() && buf->releaseStorage(&storage))
+        {
+            loop_->bufferPool()->release(&storage);
+        }
+     }
+
+     void TcpConnection::trimBuffer(Buffer *buf, size_t reserve)
+     {
+        if (buf->readableBytes() == 0)
+        {
+            returnStorage(buf);
+            return;
+        }
+        size_t storage = buf->storageBytes();
+        if (storage > kTrimMinBytes && storage > 4 * (buf->readableBytes() + reserve))
+        {
+            buf->shrink(reserve);
+        }
+     }
+
+     void TcpConnection::outputQueued(size_t oldLen)
+     {
+        //目前输出队列里待发送数据的长度
+        if (queuedBytes_ >= highWaterMark_
+            && oldLen < highWaterMark_
+            && highWaterMarkCallback_)
+        {
+            loop_->queueInLoop(
+                std::bind(highWaterMarkCallback_, shared_from_this(), queuedBytes_)
+            );
+        }
+        if (oldLen == 0 && writeTimeout_ > 0.0)
+        {
+            loop_->timingWheel()->start(&writeEntry_, writeTimeout_); // 从现在开始数据必须在writeTimeout_内发出去
+        }
+        // 显式cork的时候不注册写事件 等uncork再发；ET模式建立连接时已经注册过写事件
+        if (!corked_ && !channel_->isWriting())
+        {
+            channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+        }
+        recordQueueDepth();
+        if (autoCork_ && !corked_ && !flushQueued_)
+        {
+            // 回调里后面的send继续往队列里攒 本轮事件处理完再统一发
+            flushQueued_ = true;
+            loop_->queueInLoop(std::bind(&TcpConnection::flushInLoop, shared_from_this()));
+        }
+        checkFlowControl();
+     }
+
+     ssize_t TcpConnection::writeOutputQueue(int *savedErrno)
+     {
+        while (!outputQueue_.empty() && outputQueue_.front().kind == OutputSegment::kFile)
+        {
+            OutputSegment &segment = outputQueue_.front();
+            off_t offset = segment.offset;
+            ssize_t n = ::sendfile(channel_->fd(), segment.fd, &offset, segment.len);
+            recordWrite(n, errno);
+            if (n < 0)
+            {
+                *savedErrno = errno;
+                return n;
+            }
+            if (n > 0)
+            {
+                segment.offset += n;
+                segment.len -= n;
+                queuedBytes_ -= n;
+                if (segment.len == 0)
+                {
+                    popOutputSegment();
+                }
+                return n;
+            }
+            // 文件比sendFile给的长度短 剩下的部分没法发了，跳过去继续发后面的数据
+            LOG_ERROR("TcpConnection::writeOutputQueue [%s] file fd=%d truncated, %zu bytes dropped \n",
+                      name_.c_str(), segment.fd, segment.len);
+            queuedBytes_ -= segment.len;
+            popOutputSegment();
+        }
+
+        if (!outputQueue_.empty() && zeroCopyEligible(outputQueue_.front()))
+        {
+            return sendZeroCopy(outputQueue_.front(), savedErrno);
+        }
+
+        struct iovec vec[kMaxIovecs];
+        int iovcnt = 0;
+        size_t bufferOffset = 0; // kBuffered段在outputBuffer_里的起始位置
+        for (const OutputSegment &segment : outputQueue_)
+        {
+            if (iovcnt == kMaxIovecs || segment.kind == OutputSegment::kFile || zeroCopyEligible(segment))
+            {
+                break; // 文件和零拷贝的数据块等前面的数据发完以后单独发
+            }
+            if (segment.kind == OutputSegment::kBuffered)
+            {
+                iovcnt += outputBuffer_.readableIovecs(bufferOffset, segment.len, vec + iovcnt, kMaxIovecs - iovcnt);
+                bufferOffset += segment.len;
+            }
+            else
+            {
+                vec[iovcnt].iov_base = const_cast<char*>(segment.block->data()) + segment.offset;
+                vec[iovcnt].iov_len = segment.len;
+                ++iovcnt;
+            }
+        }
+
+        if (iovcnt == 0)
+        {
+            return 0;
+        }
+        ssize_t n = iovcnt == 1 ? ::write(channel_->fd(), vec[0].iov_base, vec[0].iov_len)
+                                : ::writev(channel_->fd(), vec, iovcnt);
+        recordWrite(n, errno);
+        if (n < 0)
+        {
+            *savedErrno = errno;
+            return n;
+        }
+
+        // 从队列头部去掉已经发出去的n个字节 发完的数据块在这里释放引用
+        size_t left = n;
+        queuedBytes_ -= left;
+        while (left > 0)
+        {
+            OutputSegment &segment = outputQueue_.front();
+            size_t m = std::min(left, segment.len);
+            if (segment.kind == OutputSegment::kBuffered)
+            {
+                outputBuffer_.retrieve(m);
+            }
+            else
+            {
+                segment.offset += m;
+            }
+            segment.len -= m;
+            left -= m;
+            if (segment.len == 0)
+            {
+                popOutputSegment();
+            }
+        }
+        return n;
+     }
+
+     bool TcpConnection::zeroCopyEligible(const OutputSegment &segment) const
+     {
+        // outputBuffer_里的数据之后还会被覆盖或者搬移 只有应用的只读数据块能零拷贝
+        return zeroCopy_ && segment.kind == OutputSegment::kBlock && segment.len >= zeroCopyThreshold_;
+     }
+
+     ssize_t TcpConnection::sendZeroCopy(OutputSegment &segment, int *savedErrno)
+     {
+        const char *data = segment.block->data() + segment.offset;
+        ssize_t n = ::send(channel_->fd(), data, segment.len, MSG_ZEROCOPY);
+        if (n < 0 && errno == ENOBUFS)
+        {
+            // 超过了optmem的限制 这一次退回普通拷贝
+            ++stats_.writeCalls;
+            n = ::send(channel_->fd(), data, segment.len, 0);
+            recordWrite(n, errno);
+        }
+        else if (n > 0)
+        {
+            recordWrite(n, 0);
+            // 发出去的页面被内核引用着 数据块要留到完成通知到了再释放
+            if (zeroCopyPending_.empty())
+            {
+                zeroCopyFirstSeq_ = zeroCopyNextSeq_;
+            }
+            zeroCopyPending_.push_back(segment.block);
+            ++zeroCopyNextSeq_;
+        }
+        else
+        {
+            recordWrite(n, errno);
+        }
+        if (n < 0)
+        {
+            *savedErrno = errno;
+            return n;
+        }
+
+        segment.offset += n;
+        segment.len -= n;
+        queuedBytes_ -= n;
+        if (segment.len == 0)
+        {
+            popOutputSegment();
+        }
+        return n;
+     }
 
-        // 之前调用过该connection的shutdown，不能再进行发送了
-        if (state_ == kDisconnected)
+// 读空fd的错误队列 完成的send在pending里置空，队头连续完成的出队
+// 返回内核是否报告过退回了拷贝
+static bool drainZeroCopyCompletions(int fd, uint32_t *firstSeq, std::deque<BlockPtr> *pending)
+{
+    bool copied = false;
+    for (;;)
+    {
+        char control[128];
+        struct msghdr msg;
+        ::memset(&msg, 0, sizeof msg);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        if (::recvmsg(fd, &msg, MSG_ERRQUEUE) < 0)
         {
-            LOG_ERROR("disconnected, give up writing \n");
-            return;
+            break; // EAGAIN 错误队列读空了
         }
 
-        // 表示channel_第一次开始写数据，而且缓冲区没有待发送数据
-        if (!channel_->isWriting() && outputBuffer_.readableBytes() == 0)
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
         {
-            nwrote = ::write(channel_->fd(), data, len);
-            if (nwrote >= 0)
+            if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                  || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
             {
-                remaining = len - nwrote;
-                if (remaining == 0 && writeCompleteCallback_)
-                {
-                    // 既然在这里数据全部发送完毕，就不用在给channel设置epollout事件了 handleWrite的前提是outputBuffer_中有待发送数据，而这里全部发送完毕了，也就不会往outputBuffer_中写数据了
-                    loop_->queueInLoop(
-                        std::bind(writeCompleteCallback_, shared_from_this())
-                    );
-                }
+                continue;
             }
-            else // nwrote < 0
+            struct sock_extended_err *serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cmsg));
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
             {
-                nwrote = 0;
-                if (errno != EWOULDBLOCK)
+                continue;
+            }
+            // [ee_info, ee_data]这一段序号的send已经完成
+            for (uint32_t seq = serr->ee_info; seq != serr->ee_data + 1; ++seq)
+            {
+                uint32_t idx = seq - *firstSeq;
+                if (idx < pending->size())
                 {
-                    LOG_ERROR("TcpConnection::sendInLoop \n");
-                    if (errno == EPIPE || errno == ECONNRESET) // SIGPIPE RESET，客户端socket重置
-                    {
-                        faultError = true;
-                    }
+                    (*pending)[idx].reset();
                 }
             }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                copied = true;
+            }
         }
+    }
 
+    while (!pending->empty() && !pending->front())
+    {
+        pending->pop_front();
+        ++*firstSeq;
+    }
+    return copied;
+}
 
-        /**
-         *  说明大概先前这一次write，并没有把数据全部发送出去，剩余的数据需要保存到缓冲区中，然后给channel
-         * 注册epollout事件，poller发现tcp的发送缓冲区(不是当前的outputBuffer，而是系统自带的buffer)有空间，会通知相应的socket-channel, 调用writeCallback回调方法
-         * 也就是调用TcpConnection::handleWrite方法， handleWrite方法再判断outputBuffer是否全部发送，没有发送继续发送，直到把发送缓冲区的数据全部发送完毕
-        */
-       if (!faultError && remaining > 0)
-       {
-        //目前发送缓冲区剩余的待发送数据的长度
-        size_t oldLen = outputBuffer_.readableBytes();
-        if (oldLen + remaining >= highWaterMark_
-            && oldLen < highWaterMark_
-            && highWaterMarkCallback_)
+namespace
+{
+// 连接销毁的时候还有没收到完成通知的零拷贝send，内核可能还在发送或者重传数据块里的页面
+// 这时候释放数据块 应用复用这块内存就会改掉线路上的数据
+// 所以dup一份fd让socket继续存在，定时读错误队列，全部完成以后才释放数据块、关掉fd
+struct ZeroCopyLinger
+{
+    ZeroCopyLinger(int fdArg, uint32_t firstSeqArg, std::deque<BlockPtr> &&blocks)
+        : fd(fdArg)
+        , firstSeq(firstSeqArg)
+        , pending(std::move(blocks))
+        , delay(kZeroCopyLingerInitDelay)
+    {}
+    ~ZeroCopyLinger() {::close(fd);}
+
+    int fd;
+    uint32_t firstSeq;
+    std::deque<BlockPtr> pending;
+    double delay; // 下一次检查的间隔 每次翻倍
+};
+}
+
+static void pollZeroCopyLinger(EventLoop *loop, const std::shared_ptr<ZeroCopyLinger> &linger)
+{
+    drainZeroCopyCompletions(linger->fd, &linger->firstSeq, &linger->pending);
+    if (linger->pending.empty())
+    {
+        LOG_DEBUG("zero copy completions drained, close lingering fd=%d \n", linger->fd);
+        return; // 定时器释放最后一个引用 数据块和fd在这里释放
+    }
+    linger->delay = std::min(linger->delay * 2, kZeroCopyLingerMaxDelay);
+    loop->runAfter(linger->delay, std::bind(&pollZeroCopyLinger, loop, linger));
+}
+
+     void TcpConnection::handleZeroCopyCompletions()
+     {
+        bool copied = drainZeroCopyCompletions(channel_->fd(), &zeroCopyFirstSeq_, &zeroCopyPending_);
+        if (copied && zeroCopy_)
         {
-            loop_->queueInLoop(
-                std::bind(highWaterMarkCallback_, shared_from_this(), oldLen+remaining)
-            );
+            // 内核最后还是拷贝了(比如走loopback) 零拷贝只剩下额外的开销，之后都用普通send
+            LOG_INFO("TcpConnection::handleZeroCopyCompletions [%s] kernel copied, zero copy disabled \n", name_.c_str());
+            zeroCopy_ = false;
         }
-        outputBuffer_.append((char*)data + nwrote, remaining);
-        if (!channel_->isWriting()) 
+     }
+
+     void TcpConnection::lingerZeroCopy()
+     {
+        handleZeroCopyCompletions();
+        if (zeroCopyPending_.empty())
         {
-            channel_->enableWriting(); // 这里一定要注册channel的写事件，否则poller不会给channel通知epollout
+            return;
+        }
+        // socket_析构的时候关掉原来的fd 有dup出来的fd在socket就不会真的关闭，也就不会发FIN 这里先关写端
+        int fd = ::fcntl(channel_->fd(), F_DUPFD_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            LOG_ERROR("TcpConnection::lingerZeroCopy [%s] dup error:%d, %zu zero copy sends released before completion \n",
+                      name_.c_str(), errno, zeroCopyPending_.size());
+            zeroCopyPending_.clear();
+            return;
         }
-       }
+        ::shutdown(fd, SHUT_WR);
+        LOG_INFO("TcpConnection::lingerZeroCopy [%s] %zu zero copy sends pending, keep fd=%d until completed \n",
+                 name_.c_str(), zeroCopyPending_.size(), fd);
+        std::shared_ptr<ZeroCopyLinger> linger(new ZeroCopyLinger(fd, zeroCopyFirstSeq_, std::move(zeroCopyPending_)));
+        zeroCopyPending_.clear();
+        loop_->runAfter(linger->delay, std::bind(&pollZeroCopyLinger, loop_, linger));
      }
 
      //关闭链接
@@ -162,18 +907,274 @@ TcpConnection::TcpConnection(EventLoop *loop,
 
      void TcpConnection::shutdownInLoop()
      {
-        if (!channel_->isWriting()) // 说明outputBuffer_中的数据已经全部发送完毕，可以直接关闭写端，否则跳过shutdown，等待数据发送完毕后，由handleWrite关闭写端
+        if (outputQueue_.empty()) // 说明输出队列中的数据已经全部发送完毕，可以直接关闭写端，否则跳过shutdown，等待数据发送完毕后，由handleWrite关闭写端
         {
             socket_->shutdownWrite(); // 关闭写端
         }
      }
 
+     void TcpConnection::forceClose()
+     {
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+            setState(kDisconnecting);
+            // 绑定shared_ptr 调用方放掉最后一个引用以后连接也要活到handleClose执行完
+            loop_->queueInLoop(std::bind(&TcpConnection::forceCloseInLoop, shared_from_this()));
+        }
+     }
+
+     void TcpConnection::forceCloseInLoop()
+     {
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+            handleClose();
+        }
+     }
+
+     void TcpConnection::cork(bool tcpCork)
+     {
+        loop_->runInLoop(std::bind(&TcpConnection::corkInLoop, shared_from_this(), tcpCork));
+     }
+
+     void TcpConnection::uncork()
+     {
+        loop_->runInLoop(std::bind(&TcpConnection::uncorkInLoop, shared_from_this()));
+     }
+
+     void TcpConnection::corkInLoop(bool tcpCork)
+     {
+        corked_ = true;
+        if (!edgeTriggered_ && channel_->isWriting())
+        {
+            channel_->disableWriting(); // LT模式还注册着写事件的话handleWrite会一直被叫醒
+        }
+        if (tcpCork && !tcpCorked_)
+        {
+            socket_->setTcpCork(true);
+            tcpCorked_ = true;
+        }
+     }
+
+     void TcpConnection::uncorkInLoop()
+     {
+        if (!corked_)
+        {
+            return;
+        }
+        corked_ = false;
+        flushOutput();
+        if (tcpCorked_)
+        {
+            socket_->setTcpCork(false);
+            tcpCorked_ = false;
+        }
+     }
+
+     void TcpConnection::flushInLoop()
+     {
+        flushQueued_ = false;
+        if (!corked_)
+        {
+            flushOutput();
+        }
+     }
+
+     void TcpConnection::flushOutput()
+     {
+        if (outputQueue_.empty() || state_ == kDisconnected)
+        {
+            return;
+        }
+        // 发完以后handleWrite会把写事件关掉 一轮里的开关在poll之前合并，不会多出epoll_ctl
+        if (!channel_->isWriting())
+        {
+            channel_->enableWriting();
+        }
+        handleWrite();
+     }
+
+     void TcpConnection::startRead()
+     {
+        loop_->runInLoop(std::bind(&TcpConnection::startReadInLoop, shared_from_this()));
+     }
+
+     void TcpConnection::stopRead()
+     {
+        loop_->runInLoop(std::bind(&TcpConnection::stopReadInLoop, shared_from_this()));
+     }
+
+     void TcpConnection::startReadInLoop()
+     {
+        reading_ = true;
+        updateReading();
+     }
+
+     void TcpConnection::stopReadInLoop()
+     {
+        reading_ = false;
+        updateReading();
+     }
+
+     void TcpConnection::setFlowControl(size_t highWaterMark, size_t lowWaterMark)
+     {
+        if (highWaterMark > 0 && lowWaterMark >= highWaterMark)
+        {
+            LOG_ERROR("TcpConnection::setFlowControl [%s] lowWaterMark=%zu not below highWaterMark=%zu, use %zu \n",
+                      name_.c_str(), lowWaterMark, highWaterMark, highWaterMark / 2);
+            lowWaterMark = highWaterMark / 2;
+        }
+        flowHighWaterMark_ = highWaterMark;
+        flowLowWaterMark_ = lowWaterMark;
+        checkFlowControl();
+     }
+
+     void TcpConnection::checkFlowControl()
+     {
+        bool paused = flowPaused_;
+        if (flowHighWaterMark_ == 0)
+        {
+            paused = false;
+        }
+        else if (queuedBytes_ >= flowHighWaterMark_)
+        {
+            paused = true;
+        }
+        else if (queuedBytes_ <= flowLowWaterMark_)
+        {
+            paused = false;
+        }
+        // 在两个水位之间保持原来的状态 避免在一个水位附近反复开关读事件
+        if (paused != flowPaused_)
+        {
+            flowPaused_ = paused;
+            updateReading();
+        }
+     }
+
+     TcpConnection::Stats TcpConnection::stats() const
+     {
+        Stats result = stats_;
+        if (highWaterSince_.valid())
+        {
+            result.highWaterMicros += microSecondsDifference(Timestamp::now(), highWaterSince_);
+        }
+        return result;
+     }
+
+     void TcpConnection::recordRead(ssize_t n, int savedErrno)
+     {
+        ++stats_.readCalls;
+        if (n > 0)
+        {
+            stats_.bytesRead += n;
+            stats_.lastActivity = loop_->pollReturnTime();
+        }
+        else if (n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))
+        {
+            ++stats_.eagainCount;
+        }
+     }
+
+     void TcpConnection::recordWrite(ssize_t n, int savedErrno)
+     {
+        ++stats_.writeCalls;
+        if (n > 0)
+        {
+            stats_.bytesWritten += n;
+            stats_.lastActivity = loop_->pollReturnTime();
+        }
+        else if (n < 0 && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))
+        {
+            ++stats_.eagainCount;
+        }
+     }
+
+     void TcpConnection::recordQueueDepth()
+     {
+        Timestamp now = loop_->pollReturnTime();
+        if (queuedBytes_ > stats_.peakOutputBytes)
+        {
+            stats_.peakOutputBytes = queuedBytes_;
+        }
+
+        bool aboveHighWater = queuedBytes_ >= highWaterMark_;
+        if (aboveHighWater && !highWaterSince_.valid())
+        {
+            highWaterSince_ = now;
+        }
+        else if (!aboveHighWater && highWaterSince_.valid())
+        {
+            stats_.highWaterMicros += microSecondsDifference(now, highWaterSince_);
+            highWaterSince_ = Timestamp::invalid();
+        }
+
+        if (queuedBytes_ > 0 && !queueSince_.valid())
+        {
+            queueSince_ = now;
+        }
+        else if (outputQueue_.empty() && queueSince_.valid())
+        {
+            int64_t wait = microSecondsDifference(now, queueSince_);
+            ++stats_.queueDrains;
+            stats_.queueWaitMicros += wait;
+            stats_.maxQueueWaitMicros = std::max(stats_.maxQueueWaitMicros, wait);
+            queueSince_ = Timestamp::invalid();
+        }
+     }
+
+     void TcpConnection::updateReading()
+     {
+        // 连接建立之前channel还没注册 connectEstablished的时候再按状态注册；断开以后事件已经全部清掉了
+        if (state_ != kConnected && state_ != kDisconnecting)
+        {
+            return;
+        }
+        bool want = reading_ && !flowPaused_;
+        if (want && !channel_->isReading())
+        {
+            channel_->enableReading();
+            if (edgeTriggered_)
+            {
+                // 暂停的时候socket里可能还有数据没读到EAGAIN，恢复以后不一定有新的边沿：
+                // 暂停和恢复在同一轮里的时候两次修改互相抵消，EventLoop不会提交EPOLL_CTL_MOD(io_uring也不会重新挂poll)
+                // 所以恢复的时候自己读一次 没有数据只是多一次EAGAIN
+                loop_->queueInLoop(
+                    std::bind(&TcpConnection::handleRead, shared_from_this(), loop_->pollReturnTime())
+                );
+            }
+        }
+        else if (!want && channel_->isReading())
+        {
+            channel_->disableReading();
+        }
+     }
+
      // 链接建立
      void TcpConnection::connectEstablished()
      {
         setState(kConnected);
         channel_->tie(shared_from_this()); // 因为channel对应的callback都来自于TcpConnection，因此需要把TcpConnection对象绑定到channel上，否则万一TcpConnection对象析构了，channel还在使用回调函数，就会出错
-        channel_->enableReading(); // 向poller注册channel的epollin事件
+        if (edgeTriggered_)
+        {
+            // ET模式读写事件一次注册好 之后不再用EPOLL_CTL_MOD切换写事件
+            channel_->setEdgeTriggered(true);
+            channel_->enableReadingAndWriting();
+        }
+        else
+        {
+            channel_->enableReading(); // 向poller注册channel的epollin事件
+        }
+        updateReading(); // 建立之前调用过stopRead
+
+        // 在连接建立之前设置的超时 从这里开始计时
+        if (idleTimeout_ > 0.0)
+        {
+            loop_->timingWheel()->start(&idleEntry_, idleTimeout_);
+        }
+        if (readTimeout_ > 0.0)
+        {
+            loop_->timingWheel()->start(&readEntry_, readTimeout_);
+        }
 
         //新链接建立，执行回调
         connectionCallback_(shared_from_this());
@@ -188,42 +1189,121 @@ TcpConnection::TcpConnection(EventLoop *loop,
             channel_->disableAll(); // 把channel的所有该兴趣的事件，从poller中del掉
             connectionCallback_(shared_from_this());
         }
+        cancelTimeouts();
         channel_->remove(); // 把channel从poller中删除掉
+        // 还有没完成的零拷贝send 数据块和socket要留到内核通知完成
+        if (!zeroCopyPending_.empty())
+        {
+            lingerZeroCopy();
+        }
+        // 连接已经不会再读写了 没处理完的数据丢掉，存储还给loop的内存池
+        inputBuffer_.retrieveAll();
+        outputBuffer_.retrieveAll();
+        returnStorage(&inputBuffer_);
+        returnStorage(&outputBuffer_);
      }
 
 // handleRead, handleWrite, handleClose, handleError都是private方法，只有TcpServer类才能调用，客户端定义的回调函数为messageCallback_，connectionCallback_，
 // writeCompleteCallback_，highWaterMarkCallback_，这些回调函数都是用户传入的，TcpServer类在调用handleRead, handleWrite, handleClose, handleError方法时，会调用用户传入的回调函数
      void TcpConnection::handleRead(Timestamp receiveTime)
      {
+        // ET模式下放到本轮末尾继续读的时候连接可能已经关闭了，或者读已经被暂停了
+        if (state_ == kDisconnected || !channel_->isReading())
+        {
+            return;
+        }
+
+        if (!inputBuffer_.hasStorage())
+        {
+            borrowStorage(&inputBuffer_, inputBuffer_.readTarget());
+        }
+
         int savedErrno = 0;
-        ssize_t n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
-        if (n > 0)
+        size_t total = 0;
+        ssize_t n = 0;
+        // LT模式读一次就返回，没读完poller下一轮还会通知；ET模式不会再通知，必须读到EAGAIN
+        do
+        {
+            n = inputBuffer_.readFd(channel_->fd(), &savedErrno);
+            recordRead(n, savedErrno);
+            if (n > 0)
+            {
+                total += n;
+            }
+        } while (edgeTriggered_ && n > 0 && total < kMaxBytesPerEvent);
+
+        if (total > 0)
         {
+            idleEntry_.refresh();
+            readEntry_.refresh();
+            ++stats_.messagesIn;
             //已建立链接的用户，当读事件发生时，调用用户传入的回调操作onMessage
             messageCallback_(shared_from_this(),&inputBuffer_, receiveTime);
         }
-        else if (n == 0){
+        // 数据都被消费掉了就还存储 等下次有数据再借；只剩半条消息的时候把突发撑大的内存缩回来
+        trimBuffer(&inputBuffer_, inputBuffer_.readTarget());
+
+        if (n == 0){
             handleClose(); //通知了读事件，但是读到的数据为0，说明对端关闭了链接
-        } else {
-            errno = savedErrno;
-            LOG_ERROR("TcpConnection::handleRead \n");
-            handleError();
+        } else if (n < 0) {
+            if (!(edgeTriggered_ && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))) // ET模式读到EAGAIN是正常结束
+            {
+                errno = savedErrno;
+                LOG_ERROR("TcpConnection::handleRead \n");
+                handleError();
+            }
+        } else if (edgeTriggered_ && channel_->isReading()) {
+            // 预算用完了但是还没读到EAGAIN，不会有新的通知，放到本轮末尾接着读
+            // 读被暂停了就不用管 updateReading恢复读的时候会再排一次handleRead
+            loop_->queueInLoop(
+                std::bind(&TcpConnection::handleRead, shared_from_this(), receiveTime)
+            );
         }
      }
 
      void TcpConnection::handleWrite()
      {
+        if (edgeTriggered_ && (outputQueue_.empty() || state_ == kDisconnected))
+        {
+            return; // ET模式写事件一直注册着，没有数据要发的时候也会收到EPOLLOUT
+        }
+        if (corked_)
+        {
+            return; // ET模式cork期间的EPOLLOUT 数据等uncork再发
+        }
+
         if (channel_->isWriting())
         {
             int savedErrno = 0;
-            ssize_t n = outputBuffer_.writeFd(channel_->fd(), &savedErrno);
-            if (n > 0)
+            size_t written = 0;
+            ssize_t n = 0;
+            // ET模式一直写到队列发完或者EAGAIN
+            do
+            {
+                n = writeOutputQueue(&savedErrno); // 发出去的n个字节已经从队列里去掉了
+                if (n > 0)
+                {
+                    written += n;
+                }
+            } while (edgeTriggered_ && n > 0 && !outputQueue_.empty() && written < kMaxBytesPerEvent);
+
+            if (written > 0 || outputQueue_.empty()) // 被截断的文件跳过以后 队列可能什么都没写就空了
             {
-                // n个字节已经发送出去了，缓冲区index向后移动n个字节
-                outputBuffer_.retrieve(n);
-                if (outputBuffer_.readableBytes() == 0) // 缓冲区中字节全部发送完毕,如果！= 0,说明这一轮还没发送完毕，继续发送
+                if (written > 0)
+                {
+                    idleEntry_.refresh();
+                    writeEntry_.refresh();
+                }
+                recordQueueDepth();
+                checkFlowControl(); // 发到低水位以下恢复读
+                if (outputQueue_.empty()) // 队列中字节全部发送完毕,如果！= 0,说明这一轮还没发送完毕，继续发送
                 {
-                    channel_->disableWriting();
+                    if (!edgeTriggered_)
+                    {
+                        channel_->disableWriting();
+                    }
+                    loop_->timingWheel()->cancel(&writeEntry_);
+                    returnStorage(&outputBuffer_);
                     if (writeCompleteCallback_)
                     {
                         //唤醒loop_对应的thread线程，执行回调
@@ -236,8 +1316,20 @@ TcpConnection::TcpConnection(EventLoop *loop,
                         shutdownInLoop();
                     }
                 }
+                else
+                {
+                    // 积压的数据发出去一部分 outputBuffer_被撑得太大就缩回来
+                    trimBuffer(&outputBuffer_, Buffer::kInitialSize);
+                    if (edgeTriggered_ && n > 0)
+                    {
+                        // 预算用完了socket还可写，不会有新的EPOLLOUT，放到本轮末尾接着写
+                        loop_->queueInLoop(
+                            std::bind(&TcpConnection::handleWrite, shared_from_this())
+                        );
+                    }
+                }
             }
-            else {
+            else if (!(edgeTriggered_ && (savedErrno == EAGAIN || savedErrno == EWOULDBLOCK))) {
                 LOG_ERROR("TcpConnection::handleWrite \n");
             }
         }
@@ -253,6 +1345,7 @@ TcpConnection::TcpConnection(EventLoop *loop,
         LOG_INFO("TcpConnection::handleClose fd=%d state=%d \n", channel_->fd(), (int)state_);
         setState(kDisconnected);
         channel_->disableAll();
+        cancelTimeouts();
 
         TcpConnectionPtr connPtr(shared_from_this());
         connectionCallback_(connPtr); //执行连接关闭的回调
@@ -269,6 +1362,13 @@ TcpConnection::TcpConnection(EventLoop *loop,
 */
      void TcpConnection::handleError()
      {
+        // MSG_ZEROCOPY的完成通知放在错误队列里 也是通过EPOLLERR报上来的
+        // 一轮里可能收到已经被前一次读空的EPOLLERR 所以只要用过零拷贝就先读一遍错误队列
+        const bool zeroCopyUsed = zeroCopyNextSeq_ != 0;
+        if (zeroCopyUsed)
+        {
+            handleZeroCopyCompletions();
+        }
         int optval;
         socklen_t optlen = sizeof optval;
         int err = 0;
@@ -279,10 +1379,66 @@ TcpConnection::TcpConnection(EventLoop *loop,
         else {
             err = optval;
         }
+        if (err == 0 && zeroCopyUsed)
+        {
+            return; // 只是零拷贝的完成通知
+        }
         LOG_ERROR("TcpConnection::handleError name:%s - SO_ERROR = %d \n", name_.c_str(),err);
      }
 
+     void TcpConnection::setIdleTimeout(double seconds)
+     {
+        loop_->runInLoop(
+            std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), &idleEntry_, &idleTimeout_, seconds)
+        );
+     }
+
+     void TcpConnection::setReadTimeout(double seconds)
+     {
+        loop_->runInLoop(
+            std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), &readEntry_, &readTimeout_, seconds)
+        );
+     }
 
+     void TcpConnection::setWriteTimeout(double seconds)
+     {
+        loop_->runInLoop(
+            std::bind(&TcpConnection::setTimeoutInLoop, shared_from_this(), &writeEntry_, &writeTimeout_, seconds)
+        );
+     }
 
+     void TcpConnection::setTimeoutInLoop(TimingWheel::Entry *entry, double *timeout, double seconds)
+     {
+        *timeout = seconds;
+        TimingWheel *wheel = loop_->timingWheel();
+        if (seconds <= 0.0)
+        {
+            wheel->cancel(entry);
+        }
+        else if (state_ == kConnected || state_ == kDisconnecting)
+        {
+            // 还没建立的连接在connectEstablished里启动 写超时只在有数据待发送的时候启动
+            if (entry != &writeEntry_ || !outputQueue_.empty())
+            {
+                wheel->start(entry, seconds);
+            }
+        }
+     }
 
+     void TcpConnection::cancelTimeouts()
+     {
+        TimingWheel *wheel = loop_->timingWheel();
+        wheel->cancel(&idleEntry_);
+        wheel->cancel(&readEntry_);
+        wheel->cancel(&writeEntry_);
+     }
 
+     // 时间轮上的某个超时到期了 和对端关闭一样走handleClose
+     void TcpConnection::handleTimeout(const char *what)
+     {
+        LOG_INFO("TcpConnection::handleTimeout [%s] - %s timeout, closing \n", name_.c_str(), what);
+        if (state_ == kConnected || state_ == kDisconnecting)
+        {
+            handleClose();
+        }
+     }
@@ -5,14 +5,21 @@
 #include "Callbacks.h"
 #include "Buffer.h"
 #include "Timestamp.h"
+#include "TimingWheel.h"
 
 #include <memory>
 #include <string>
 #include <atomic>
+#include <deque>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
 
 class Channel;
 class EventLoop;
 class Socket;
+struct iovec;
 
 /**
  * TcpServer => Acceptor => 有一个新用户链接，通过accept函数拿到connfd
@@ -40,13 +47,66 @@ public:
 
     bool connected() const {return state_ == kConnected;}
 
+    // 应用自己的一段内存 只在send调用期间有效
+    struct Slice
+    {
+        Slice(const void *d, size_t l) : data(d), len(l) {}
+        Slice(const std::string &s) : data(s.data()), len(s.size()) {}
+        const void *data;
+        size_t len;
+    };
+
     //发送数据 调用messageCallback结束后，系统可能需要给客户端发送消息，所以需要提供一个send接口
+    // 在其他线程调用的时候数据要先拷一份再交给loop线程 不想拷贝就用下面的右值/Buffer/数据块版本
     void send(const std::string &buff);
-
     void send(const void *message, size_t len);
+    // 跨线程的时候string直接move成数据块交给loop线程 不拷贝数据
+    void send(std::string &&buff);
+    // 发送buf里所有可读的数据 返回以后buf为空
+    // 输出缓冲区里没有数据的时候，没发完的部分连同底层存储一起换进outputBuffer_，不拷贝；
+    // 跨线程的时候先把buf的存储换出来交给loop线程
+    void send(Buffer *buf);
+
+    // 比如header+body+trailer 输出队列为空的时候一次writev发出去，没发完的部分才拷进outputBuffer_
+    void send(const std::vector<Slice> &slices);
+    // 数据块按引用排进输出队列 和前后的数据一起writev 不会拷进outputBuffer_
+    void send(const BlockPtr &block);
+    void send(const std::vector<BlockPtr> &blocks);
+    // 用sendfile(2)把文件[offset, offset+length)发出去 数据不经过用户态
+    // 和前面send的数据按顺序排队，发完以后同样回调writeCompleteCallback_，长度计入高水位
+    // fd在调用的时候dup一份，调用返回以后应用就可以关掉自己的fd
+    void sendFile(int fd, off_t offset, size_t length);
 
     //关闭连接
     void shutdown();
+    // 不等输出队列发完 直接关闭连接 线程安全
+    void forceClose();
+
+    // 暂停/恢复读 只是不再关注读事件，数据留在内核的接收缓冲区里，对端发得快会被TCP窗口挡住
+    // 线程安全 比如代理把下游连接的高水位回调里stopRead上游，写完回调里再startRead
+    void startRead();
+    void stopRead();
+    bool isReading() const {return reading_;}
+
+    // 写合并 自动模式下loop线程里的send都先排进输出队列，本轮事件处理完(下一次poll之前)再一次writev发出去
+    // 一个回调里多次send只有一次系统调用，对端收到的也是满的包 在loop线程中或者connectEstablished之前调用
+    void setAutoCork(bool on) {autoCork_ = on;}
+    // 显式的写合并 cork以后send的数据都攒在输出队列里，直到uncork才一次发出去 线程安全
+    // tcpCork为true的时候同时打开socket的TCP_CORK，uncork把数据写完以后关掉，内核里不满一个包的尾巴也一起推出去
+    void cork(bool tcpCork = false);
+    void uncork();
+
+    // 自动流控 输出队列超过highWaterMark就暂停读，发到lowWaterMark以下再恢复 highWaterMark为0表示关闭
+    // 自动暂停和stopRead是分开记的，应用stopRead以后不会被自动恢复 在loop线程中或者connectEstablished之前调用
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark);
+
+    // 超时时间 单位秒，0表示关闭 超时以后走handleClose关闭连接
+    // 空闲超时：既没有收到数据也没有发出数据
+    void setIdleTimeout(double seconds);
+    // 读超时：没有收到数据
+    void setReadTimeout(double seconds);
+    // 写超时：outputBuffer_中有数据但是一直发不出去(对端不读)
+    void setWriteTimeout(double seconds);
 
     void setConnectionCallback(const ConnectionCallback& cb)
     {connectionCallback_ = cb;}
@@ -63,6 +123,52 @@ public:
     void setCloseCallback(const CloseCallback& cb)
     {closeCallback_ = cb;}
 
+    // 使用epoll边沿触发 只能在connectEstablished之前设置
+    // 读写事件在建立连接的时候一次注册好，handleRead/handleWrite一直读写到EAGAIN
+    // loop的poller不支持边沿触发(poll)的时候忽略 还是水平触发
+    void setEdgeTriggered(bool on);
+    bool edgeTriggered() const {return edgeTriggered_;}
+
+    static const size_t kDefaultZeroCopyThreshold = 64 * 1024;
+    // 不小于threshold的数据块(send(BlockPtr))用MSG_ZEROCOPY发送，内核直接从数据块的页面发，不再拷进socket缓冲区
+    // 数据块的引用一直持有到内核从错误队列通知发送完成，连接关闭以后也一样(dup一份fd继续读错误队列)
+    // 在loop线程中调用，内核不支持SO_ZEROCOPY的时候忽略
+    void setZeroCopy(bool on, size_t threshold = kDefaultZeroCopyThreshold);
+
+    // 输出缓冲区使用分块模式 大量积压的时候append不会搬移已有的数据 只能在connectEstablished之前设置
+    void setChunkedOutputBuffer(bool on) {outputBuffer_.setChunked(on);}
+
+    // 连接自己的流量统计 都是loop线程里的普通计数，不加锁也不用原子操作
+    // 时间都取loop本轮poll返回时缓存的时间 精度是一轮事件循环
+    struct Stats
+    {
+        Stats()
+            : bytesRead(0), bytesWritten(0), messagesIn(0), messagesOut(0)
+            , readCalls(0), writeCalls(0), eagainCount(0), peakOutputBytes(0)
+            , highWaterMicros(0), queueDrains(0), queueWaitMicros(0), maxQueueWaitMicros(0)
+        {}
+        int64_t bytesRead;
+        int64_t bytesWritten;
+        int64_t messagesIn; // messageCallback的次数
+        int64_t messagesOut; // send/sendFile的次数
+        int64_t readCalls; // read/readv系统调用
+        int64_t writeCalls; // write/writev/send/sendfile系统调用
+        int64_t eagainCount; // 读写返回EAGAIN的次数
+        size_t peakOutputBytes; // 输出队列的最大深度
+        int64_t highWaterMicros; // 输出队列在高水位以上的累计时间 包括还没结束的这一段
+        int64_t queueDrains; // 输出队列从有数据到发完的次数
+        int64_t queueWaitMicros; // 每次排队到发完的时间之和 除以queueDrains是平均等待时间
+        int64_t maxQueueWaitMicros;
+        Timestamp lastActivity; // 最后一次收到或者发出数据
+    };
+    // 只能在loop线程中调用 跨线程用TcpServer::getConnectionStats
+    Stats stats() const;
+
+    // 输入/输出缓冲区里的数据量和底层占用的内存 只能在loop线程中调用
+    // 输出队列里引用的应用数据块和文件不算
+    size_t bufferedBytes() const {return inputBuffer_.readableBytes() + outputBuffer_.readableBytes();}
+    size_t bufferStorageBytes() const {return inputBuffer_.storageBytes() + outputBuffer_.storageBytes();}
+
     //链接建立
     void connectEstablished();
     //链接销毁
@@ -75,14 +181,91 @@ private:
     void handleWrite();
     void handleClose();
     void handleError();
+    void handleTimeout(const char *what);
+
+    void setTimeoutInLoop(TimingWheel::Entry *entry, double *timeout, double seconds);
+    void cancelTimeouts();
+
+    /**
+     * 输出队列 按发送顺序保存还没发出去的数据，handleWrite把队列前面的若干段拼成一次writev
+     *  kBuffered : 数据在outputBuffer_里 相邻的合并成一段，各段按顺序对应outputBuffer_里的字节
+     *  kBlock    : 应用的数据块 只持有引用
+     *  kFile     : sendFile的文件 排到队头的时候单独用sendfile发，前面的数据先writev发完
+    */
+    struct OutputSegment
+    {
+        enum Kind {kBuffered, kBlock, kFile};
+        Kind kind;
+        BlockPtr block;
+        int fd; // kFile dup出来的fd 出队的时候关掉
+        size_t offset; // block里已经发出去的字节 或者文件下一次发送的位置
+        size_t len; // 还没发出去的字节
+    };
 
     void sendInLoop(const void* message, size_t len);
+    void sendSlicesInLoop(const struct iovec *vec, int iovcnt);
+    void sendBlocksInLoop(const std::vector<BlockPtr> &blocks);
+    void sendBufferInLoop(Buffer *buf);
+    // 跨线程的send(Buffer*) 持有换出来的存储直到loop线程发完
+    void sendOwnedBufferInLoop(const std::shared_ptr<Buffer> &buf);
+    // 输出队列为空的时候直接写 返回写出去的字节数
+    size_t writeDirectly(const struct iovec *vec, int iovcnt, size_t total, bool *faultError);
+    void enqueueBytes(const char *data, size_t len);
+    // outputBuffer_末尾新增的len字节排进输出队列
+    void enqueueBuffered(size_t len);
+    void enqueueBlock(const BlockPtr &block, size_t offset);
+    void sendFileInLoop(int fd, off_t offset, size_t length);
+    void popOutputSegment();
+    // 缓冲区的底层存储从loop的BufferPool借 空了就还回去
+    void borrowStorage(Buffer *buf, size_t size);
+    void returnStorage(Buffer *buf);
+    // 缓冲区空了就还给内存池 还有数据但是占的内存远大于数据量就缩小
+    void trimBuffer(Buffer *buf, size_t reserve);
+    // 输出队列为空的时候排进来的数据先尝试发一次 然后和outputQueued一样
+    void startOutput(size_t oldLen);
+    bool zeroCopyEligible(const OutputSegment &segment) const;
+    ssize_t sendZeroCopy(OutputSegment &segment, int *savedErrno);
+    // 从错误队列读出MSG_ZEROCOPY的完成通知 释放对应的数据块
+    void handleZeroCopyCompletions();
+    // 连接销毁时还有没完成的零拷贝send 把数据块和dup出来的fd交给定时器，收齐完成通知再释放
+    void lingerZeroCopy();
+    // 排完队以后 检查高水位、启动写超时、注册写事件
+    void outputQueued(size_t oldLen);
+    // 把输出队列前面的数据用一次writev发出去
+    ssize_t writeOutputQueue(int *savedErrno);
     void shutdownInLoop();
+    void forceCloseInLoop();
+    void startReadInLoop();
+    void stopReadInLoop();
+    void corkInLoop(bool tcpCork);
+    void uncorkInLoop();
+    // send要不要先排队 不直接写
+    bool deferWrites() const {return corked_ || autoCork_;}
+    // 自动写合并 本轮末尾把攒下的数据发出去
+    void flushInLoop();
+    void flushOutput();
+    // 每次读写系统调用以后更新统计
+    void recordRead(ssize_t n, int savedErrno);
+    void recordWrite(ssize_t n, int savedErrno);
+    // 输出队列长度变化以后更新峰值和高水位时间
+    void recordQueueDepth();
+    // 按reading_和流控状态开关channel的读事件
+    void updateReading();
+    // 输出队列长度变化以后检查要不要暂停或者恢复读
+    void checkFlowControl();
 
     EventLoop *loop_; //这里不是base loop,因为TcpConnection是在subloop里面管理的
     const std::string name_;
     std::atomic_int state_;
-    bool reading_;
+    bool reading_; // 应用希望读 stopRead以后为false
+    bool flowPaused_; // 输出队列超过流控高水位 自动暂停了读
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
+    bool autoCork_;
+    bool corked_; // cork()以后到uncork()之前
+    bool tcpCorked_; // socket打开了TCP_CORK
+    bool flushQueued_; // 本轮末尾的flushInLoop已经排上了
+    bool edgeTriggered_;
 
     //这里和Acceptor类似，Acceptor => mainLoop TcpConnection => subLoop
     std::unique_ptr<Socket> socket_;
@@ -98,6 +281,28 @@ private:
     CloseCallback closeCallback_;
     size_t highWaterMark_;
 
+    // 两个缓冲区开始都没有底层存储 有数据的时候从BufferPool借，空了就还
     Buffer inputBuffer_; //接收数据的缓冲区
-    Buffer outputBuffer_; //发送数据的缓冲区
+    Buffer outputBuffer_; //发送数据的缓冲区 只保存输出队列里kBuffered的数据
+    std::deque<OutputSegment> outputQueue_;
+    size_t queuedBytes_; // 输出队列里所有还没发出去的字节
+
+    // MSG_ZEROCOPY 内核给每次成功的send一个递增的序号，完成通知里是一段序号区间
+    bool zeroCopy_;
+    size_t zeroCopyThreshold_;
+    uint32_t zeroCopyNextSeq_; // 下一次send的序号
+    uint32_t zeroCopyFirstSeq_; // zeroCopyPending_第一个元素的序号
+    std::deque<BlockPtr> zeroCopyPending_; // 已经完成的置空 队头完成以后出队
+
+    Stats stats_;
+    Timestamp highWaterSince_; // 这一段高水位开始的时间 不在高水位以上的时候无效
+    Timestamp queueSince_; // 输出队列这一次开始积压的时间
+
+    // 挂在loop的时间轮上 刷新超时只需要O(1)而且不分配内存
+    double idleTimeout_;
+    double readTimeout_;
+    double writeTimeout_;
+    TimingWheel::Entry idleEntry_;
+    TimingWheel::Entry readEntry_;
+    TimingWheel::Entry writeEntry_;
 };
\ No newline at end of file
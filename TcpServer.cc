@@ -1,9 +1,11 @@
 #include "TcpServer.h"
 #include "Logger.h"
 #include "TcpConnection.h"
+#include "BufferPool.h"
 
 #include "strings.h"
 #include "functional"
+#include <mutex>
 
 static EventLoop* checkLoopNotNull(EventLoop * loop)
 {
@@ -26,6 +28,11 @@ TcpServer :: TcpServer(EventLoop *loop,
                         , connectionCallback_() // empty function object 如果用户没有设置回调，就是空函数对象，没有任何操作
                         , messageCallback_()
                         , nextConnId_(1)
+                        , edgeTriggered_(false)
+                        , chunkedOutputBuffer_(false)
+                        , autoCork_(false)
+                        , flowHighWaterMark_(0)
+                        , flowLowWaterMark_(0)
                         , started_(0)
 {
     // 当有用户链接时，会执行TcpServer::newConnection回调
@@ -103,6 +110,10 @@ void TcpServer::newConnection(int sockfd, const InetAddress &peerAddr)
     conn -> setConnectionCallback(connectionCallback_);
     conn -> setMessageCallback(messageCallback_);
     conn -> setWriteCompleteCallback(writeCompleteCallback_);
+    conn -> setEdgeTriggered(edgeTriggered_);
+    conn -> setChunkedOutputBuffer(chunkedOutputBuffer_);
+    conn -> setAutoCork(autoCork_);
+    conn -> setFlowControl(flowHighWaterMark_, flowLowWaterMark_);
 
     // 设置链接关闭的回调 conn -> shutDown()
     conn -> setCloseCallback(std::bind(&TcpServer::removeConnection, this, std::placeholders::_1));
@@ -126,4 +137,131 @@ void TcpServer::removeConnectionInLoop(const TcpConnectionPtr &conn)
     EventLoop *ioLoop = conn -> getLoop();
     //connection设置了coonectDestoryed和connectEstablished的回调，这里通过TcpServer::removeConnectionInLoop()来调用
     ioLoop -> queueInLoop(std::bind(&TcpConnection::connectDestroyed, conn));
-}
\ No newline at end of file
+}
+void TcpServer::getBufferStats(BufferStatsCallback cb)
+{
+    // connections_只在base loop里访问
+    loop_ -> runInLoop(std::bind(&TcpServer::getBufferStatsInLoop, this, std::move(cb)));
+}
+
+namespace
+{
+// 多个loop一起汇总 最后一个完成的loop回调
+struct PendingBufferStats
+{
+    std::mutex mutex;
+    TcpServer::BufferStats total;
+    size_t remaining;
+    TcpServer::BufferStatsCallback cb;
+};
+
+struct PendingConnectionStats
+{
+    std::mutex mutex;
+    std::vector<TcpServer::ConnectionStats> all;
+    size_t remaining;
+    TcpServer::ConnectionStatsCallback cb;
+};
+}
+
+void TcpServer::getBufferStatsInLoop(const BufferStatsCallback &cb)
+{
+    std::map<EventLoop*, std::vector<TcpConnectionPtr>> byLoop;
+    for (EventLoop *ioLoop : threadPool_ -> getAllLoops())
+    {
+        byLoop[ioLoop]; // 没有连接的loop也要统计内存池
+    }
+    for (auto &item : connections_)
+    {
+        byLoop[item.second -> getLoop()].push_back(item.second);
+    }
+
+    std::shared_ptr<PendingBufferStats> pending = std::make_shared<PendingBufferStats>();
+    pending -> remaining = byLoop.size();
+    pending -> cb = cb;
+    for (auto &item : byLoop)
+    {
+        EventLoop *ioLoop = item.first;
+        std::vector<TcpConnectionPtr> conns;
+        conns.swap(item.second);
+        ioLoop -> runInLoop([pending, ioLoop, conns]() {
+            BufferStats stats;
+            for (const TcpConnectionPtr &conn : conns)
+            {
+                ++stats.connections;
+                stats.usedBytes += conn -> bufferedBytes();
+                stats.retainedBytes += conn -> bufferStorageBytes();
+            }
+            stats.pooledBytes = ioLoop -> bufferPool() -> stats().pooledBytes;
+
+            bool done = false;
+            {
+                std::lock_guard<std::mutex> lock(pending -> mutex);
+                pending -> total.connections += stats.connections;
+                pending -> total.usedBytes += stats.usedBytes;
+                pending -> total.retainedBytes += stats.retainedBytes;
+                pending -> total.pooledBytes += stats.pooledBytes;
+                done = --pending -> remaining == 0;
+            }
+            if (done && pending -> cb)
+            {
+                pending -> cb(pending -> total);
+            }
+        });
+    }
+}
+
+void TcpServer::getConnectionStats(ConnectionStatsCallback cb)
+{
+    loop_ -> runInLoop(std::bind(&TcpServer::getConnectionStatsInLoop, this, std::move(cb)));
+}
+
+void TcpServer::getConnectionStatsInLoop(const ConnectionStatsCallback &cb)
+{
+    std::map<EventLoop*, std::vector<TcpConnectionPtr>> byLoop;
+    for (auto &item : connections_)
+    {
+        byLoop[item.second -> getLoop()].push_back(item.second);
+    }
+    if (byLoop.empty())
+    {
+        if (cb)
+        {
+            cb(std::vector<ConnectionStats>());
+        }
+        return;
+    }
+
+    std::shared_ptr<PendingConnectionStats> pending = std::make_shared<PendingConnectionStats>();
+    pending -> remaining = byLoop.size();
+    pending -> cb = cb;
+    for (auto &item : byLoop)
+    {
+        EventLoop *ioLoop = item.first;
+        std::vector<TcpConnectionPtr> conns;
+        conns.swap(item.second);
+        ioLoop -> runInLoop([pending, conns]() {
+            std::vector<ConnectionStats> local;
+            local.reserve(conns.size());
+            for (const TcpConnectionPtr &conn : conns)
+            {
+                ConnectionStats entry;
+                entry.name = conn -> name();
+                entry.peerAddress = conn -> peerAddress();
+                entry.stats = conn -> stats();
+                local.push_back(entry);
+            }
+
+            bool done = false;
+            {
+                std::lock_guard<std::mutex> lock(pending -> mutex);
+                pending -> all.insert(pending -> all.end(), local.begin(), local.end());
+                done = --pending -> remaining == 0;
+            }
+            if (done && pending -> cb)
+            {
+                pending -> cb(pending -> all);
+            }
+        });
+    }
+}
@@ -17,6 +17,8 @@
 #include <memory> // std::shared_ptr
 #include <atomic>
 #include <unordered_map>
+#include <map>
+#include <vector>
 
 
 //对外的服务器编程使用的类
@@ -24,6 +26,26 @@ class TcpServer : noncopyable {
 public:
     using ThreadInitCallback = std::function<void (EventLoop*)>;
 
+    //所有连接的缓冲区内存统计
+    struct BufferStats
+    {
+        BufferStats() : connections(0), usedBytes(0), retainedBytes(0), pooledBytes(0) {}
+        int64_t connections;
+        int64_t usedBytes; //缓冲区里实际的数据
+        int64_t retainedBytes; //缓冲区占着的内存 包括没用上的容量
+        int64_t pooledBytes; //各个loop的BufferPool里缓存着的内存
+    };
+    using BufferStatsCallback = std::function<void (const BufferStats&)>;
+
+    //一个连接的流量统计快照
+    struct ConnectionStats
+    {
+        std::string name;
+        InetAddress peerAddress;
+        TcpConnection::Stats stats;
+    };
+    using ConnectionStatsCallback = std::function<void (const std::vector<ConnectionStats>&)>;
+
     enum Option {
         kNoReusePort,
         kReusePort
@@ -44,14 +66,35 @@ public:
 
     //设置底层subloop的个数
     void setThreadNum(int numThreads);
+    //start以后可以用getAllLoops拿到io loop 把TcpClient放在这些loop上，出站连接和入站连接共用线程
+    std::shared_ptr<EventLoopThreadPool> threadPool() {return threadPool_;}
+
+    //新连接使用epoll的边沿触发模式 需要在start之前设置
+    void setEdgeTriggered(bool on) {edgeTriggered_ = on;}
+    //新连接的输出缓冲区使用分块模式 适合会积压大量待发送数据的服务
+    void setChunkedOutputBuffer(bool on) {chunkedOutputBuffer_ = on;}
+    //新连接打开自动写合并 一个回调里的多次send在本轮末尾合成一次writev 见TcpConnection::setAutoCork
+    void setAutoCork(bool on) {autoCork_ = on;}
+    //新连接的自动流控 输出队列超过highWaterMark暂停读，低于lowWaterMark恢复 见TcpConnection::setFlowControl
+    void setFlowControl(size_t highWaterMark, size_t lowWaterMark)
+    {flowHighWaterMark_ = highWaterMark; flowLowWaterMark_ = lowWaterMark;}
 
     //开启服务器监听
     void start();
 
+    //线程安全 连接的缓冲区只能在各自的loop线程里读，所以统计是异步的：
+    //每个loop统计自己的连接和内存池，全部汇总以后在最后完成统计的那个loop线程里回调cb
+    void getBufferStats(BufferStatsCallback cb);
+    //线程安全 和getBufferStats一样每个loop在自己的线程里拷一份连接的统计，数据路径上不加锁
+    //全部拷完以后回调cb 可以按bytesRead/peakOutputBytes排序找出最忙的对端
+    void getConnectionStats(ConnectionStatsCallback cb);
+
 private:
     void newConnection(int sockfd, const InetAddress &peerAddr);
     void removeConnection(const TcpConnectionPtr &conn);
     void removeConnectionInLoop(const TcpConnectionPtr &conn);
+    void getBufferStatsInLoop(const BufferStatsCallback &cb);
+    void getConnectionStatsInLoop(const ConnectionStatsCallback &cb);
 
     using ConnectionMap = std::unordered_map<std::string, TcpConnectionPtr>;
 
@@ -72,5 +115,10 @@ private:
     std::atomic_int started_;
 
     int nextConnId_;
+    bool edgeTriggered_;
+    bool chunkedOutputBuffer_;
+    bool autoCork_;
+    size_t flowHighWaterMark_;
+    size_t flowLowWaterMark_;
     ConnectionMap connections_; // 保存所有链接
 };
\ No newline at end of file
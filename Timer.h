@@ -0,0 +1,43 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+
+#include <atomic>
+
+/**
+ * 定时器 记录到期时间、回调以及是否重复
+ * Timer只在TimerQueue内部使用，用户通过TimerId来取消定时器
+*/
+class Timer : noncopyable
+{
+public:
+    Timer(TimerCallback cb, Timestamp when, double interval)
+        : callback_(std::move(cb))
+        , expiration_(when)
+        , interval_(interval)
+        , repeat_(interval > 0.0)
+        , sequence_(++numCreated_)
+    {}
+
+    void run() const {callback_();}
+
+    Timestamp expiration() const {return expiration_;}
+    bool repeat() const {return repeat_;}
+    int64_t sequence() const {return sequence_;}
+
+    // 重复定时器到期以后，根据interval_计算下一次的到期时间
+    void restart(Timestamp now);
+
+    static int64_t numCreated() {return numCreated_;}
+
+private:
+    const TimerCallback callback_;
+    Timestamp expiration_;
+    const double interval_; // 单位是秒 0表示只执行一次
+    const bool repeat_;
+    const int64_t sequence_; // 全局唯一的序号 用来区分地址被复用的Timer
+
+    static std::atomic<int64_t> numCreated_;
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+class Timer;
+
+/**
+ * 对外暴露的定时器标识 runAt/runAfter/runEvery返回它，cancel的时候传回来
+ * 只保存Timer的地址和序号，序号用来防止Timer被释放后地址被新Timer复用
+*/
+class TimerId
+{
+public:
+    TimerId()
+        : timer_(nullptr)
+        , sequence_(0)
+    {}
+
+    TimerId(Timer *timer, int64_t seq)
+        : timer_(timer)
+        , sequence_(seq)
+    {}
+
+    friend class TimerQueue;
+
+private:
+    Timer *timer_;
+    int64_t sequence_;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "Timestamp.h"
+#include "Callbacks.h"
+#include "Channel.h"
+
+#include <set>
+#include <vector>
+#include <utility>
+
+class EventLoop;
+class Timer;
+class TimerId;
+
+/**
+ * 每个EventLoop持有一个TimerQueue
+ * 所有定时器共用一个timerfd，timerfd作为普通的Channel挂在Poller上，超时时间设置为最早到期的定时器
+ * 到期以后在loop线程里一次性取出所有已经到期的定时器并执行回调，不需要额外的线程
+ *
+ * 定时器按(到期时间, Timer*)保存在std::set中，插入和取消都是O(log n)
+*/
+class TimerQueue : noncopyable
+{
+public:
+    explicit TimerQueue(EventLoop *loop);
+    ~TimerQueue();
+
+    // 线程安全 可以在其他线程中调用
+    TimerId addTimer(TimerCallback cb, Timestamp when, double interval);
+    void cancel(TimerId timerId);
+
+private:
+    using Entry = std::pair<Timestamp, Timer*>;
+    using TimerList = std::set<Entry>;
+    using ActiveTimer = std::pair<Timer*, int64_t>;
+    using ActiveTimerSet = std::set<ActiveTimer>;
+
+    void addTimerInLoop(Timer *timer);
+    void cancelInLoop(TimerId timerId);
+    // timerfd可读 说明有定时器到期了 receiveTime是本轮poll返回时缓存的时间
+    void handleRead(Timestamp receiveTime);
+    // 取出所有到期的定时器
+    std::vector<Entry> getExpired(Timestamp now);
+    // 重复定时器重新插入 一次性定时器删除
+    void reset(const std::vector<Entry> &expired, Timestamp now);
+
+    bool insert(Timer *timer);
+
+    EventLoop *loop_;
+    const int timerfd_;
+    Channel timerfdChannel_;
+    TimerList timers_; // 按到期时间排序
+
+    // 和timers_保存同样的定时器 按Timer*排序 cancel的时候用来查找
+    ActiveTimerSet activeTimers_;
+    bool callingExpiredTimers_;
+    // 正在执行到期回调的时候被cancel的重复定时器 reset的时候不再插入
+    ActiveTimerSet cancelingTimers_;
+};
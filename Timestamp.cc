@@ -8,15 +8,47 @@ Timestamp::Timestamp():microSecondsSinceEpoch_(0){};
 Timestamp::Timestamp(int64_t microSecondsSinceEpoch)
 :microSecondsSinceEpoch_(microSecondsSinceEpoch){};
 
+// 定时器需要微秒精度 time(NULL)只能精确到秒
+// clock_gettime走vDSO 不会陷入内核
 Timestamp Timestamp::now(){
-    time_t ti = time(NULL);
-    return Timestamp(time(NULL));
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t seconds = ts.tv_sec;
+    return Timestamp(seconds * kMicroSecondsPerSecond + ts.tv_nsec / 1000);
+};
+
+int64_t Timestamp::monotonicNanos(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t seconds = ts.tv_sec;
+    return seconds * kNanoSecondsPerSecond + ts.tv_nsec;
+};
 
+std::string Timestamp::toFormattedString(bool showMicroseconds) const{
+    char buf[64] = {0};
+    time_t seconds = secondsSinceEpoch();
+    struct tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    if (showMicroseconds)
+    {
+        int microseconds = static_cast<int>(microSecondsSinceEpoch_ % kMicroSecondsPerSecond);
+        snprintf(buf, sizeof buf, "%4d%02d%02d %02d:%02d:%02d.%06d",
+            tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+            tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec, microseconds);
+    }
+    else
+    {
+        snprintf(buf, sizeof buf, "%4d%02d%02d %02d:%02d:%02d",
+            tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+            tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+    }
+    return buf;
 };
 
 std::string Timestamp::toString() const{
     char buf[128] = {0};
-    tm *tm_time = localtime(&microSecondsSinceEpoch_);
+    time_t seconds = secondsSinceEpoch();
+    tm *tm_time = localtime(&seconds);
     snprintf(buf, 128, "%4d%02d%02d %02d:%02d:%02d",
     tm_time ->tm_year + 1900,
     tm_time ->tm_mon + 1,
@@ -30,4 +62,4 @@ std::string Timestamp::toString() const{
 // int main() {
 //     std::cout << Timestamp::now().toString() << std::endl;
 //     return 0;
-// }
\ No newline at end of file
+// }
@@ -2,14 +2,66 @@
 
 #include <iostream>
 #include <string>
+#include <time.h>
 
 class  Timestamp
 {
     public:
     Timestamp();
     explicit Timestamp(int64_t microSecondsSinceEpoch);
+    // 墙上时间 微秒精度
     static Timestamp now();
+    static Timestamp invalid() {return Timestamp();}
+    // 单调时钟 纳秒精度 不受系统时间调整影响 用来测量耗时和延迟
+    static int64_t monotonicNanos();
+
     std::string toString() const;
+    // 20261018 01:07:39.123456
+    std::string toFormattedString(bool showMicroseconds = true) const;
+
+    int64_t microSecondsSinceEpoch() const {return microSecondsSinceEpoch_;}
+    time_t secondsSinceEpoch() const
+    {return static_cast<time_t>(microSecondsSinceEpoch_ / kMicroSecondsPerSecond);}
+    bool valid() const {return microSecondsSinceEpoch_ > 0;}
+
+    static const int kMicroSecondsPerSecond = 1000 * 1000;
+    static const int64_t kNanoSecondsPerSecond = 1000 * 1000 * 1000;
     private:
         int64_t microSecondsSinceEpoch_; //必须include <iostream>否则会报错
-};
\ No newline at end of file
+};
+
+// TimerQueue用std::set按到期时间排序，需要比较操作
+inline bool operator<(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() < rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator==(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() == rhs.microSecondsSinceEpoch();
+}
+
+inline bool operator<=(Timestamp lhs, Timestamp rhs)
+{
+    return lhs.microSecondsSinceEpoch() <= rhs.microSecondsSinceEpoch();
+}
+
+// high - low 单位是秒 比如用receiveTime算消息的处理延迟
+inline double timeDifference(Timestamp high, Timestamp low)
+{
+    int64_t diff = high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+    return static_cast<double>(diff) / Timestamp::kMicroSecondsPerSecond;
+}
+
+// high - low 单位是微秒
+inline int64_t microSecondsDifference(Timestamp high, Timestamp low)
+{
+    return high.microSecondsSinceEpoch() - low.microSecondsSinceEpoch();
+}
+
+// 在timestamp的基础上加上seconds秒 用来计算定时器的到期时间
+inline Timestamp addTime(Timestamp timestamp, double seconds)
+{
+    int64_t delta = static_cast<int64_t>(seconds * Timestamp::kMicroSecondsPerSecond);
+    return Timestamp(timestamp.microSecondsSinceEpoch() + delta);
+}
@@ -0,0 +1,177 @@
+#include "TimingWheel.h"
+#include "EventLoop.h"
+#include "Timestamp.h"
+#include "Logger.h"
+
+#include <math.h>
+
+TimingWheel::Entry::Entry()
+    : wheel_(nullptr)
+    , prev_(nullptr)
+    , next_(nullptr)
+    , deadline_(0)
+    , timeoutTicks_(0)
+{
+}
+
+TimingWheel::Entry::~Entry()
+{
+    if (wheel_)
+    {
+        wheel_->cancel(this);
+    }
+}
+
+TimingWheel::TimingWheel(EventLoop *loop, double tickSeconds, int numSlots)
+    : loop_(loop)
+    , tickSeconds_(tickSeconds)
+    , tickMicroSeconds_(static_cast<int64_t>(tickSeconds * Timestamp::kMicroSecondsPerSecond))
+    , numSlots_(numSlots)
+    , originMicroSeconds_(Timestamp::now().microSecondsSinceEpoch())
+    , slots_(numSlots)
+    , currentTick_(0)
+    , count_(0)
+    , ticking_(false)
+{
+    if (tickMicroSeconds_ <= 0 || numSlots_ <= 0)
+    {
+        LOG_FATAL("TimingWheel tick=%f slots=%d invalid \n", tickSeconds, numSlots);
+    }
+    // 哨兵节点自己指向自己 表示空链表
+    for (Entry &head : slots_)
+    {
+        head.prev_ = head.next_ = &head;
+    }
+}
+
+TimingWheel::~TimingWheel()
+{
+    if (ticking_)
+    {
+        loop_->cancel(tickTimer_);
+    }
+    for (Entry &head : slots_)
+    {
+        while (head.next_ != &head)
+        {
+            Entry *entry = head.next_;
+            unlink(entry);
+            entry->wheel_ = nullptr;
+        }
+    }
+}
+
+int64_t TimingWheel::ticksAt(Timestamp time) const
+{
+    int64_t elapsed = time.microSecondsSinceEpoch() - originMicroSeconds_;
+    return elapsed > 0 ? elapsed / tickMicroSeconds_ : 0;
+}
+
+void TimingWheel::start(Entry *entry, double timeout)
+{
+    if (entry->wheel_)
+    {
+        unlink(entry);
+    }
+    else
+    {
+        ++count_;
+        entry->wheel_ = this;
+    }
+
+    if (!ticking_)
+    {
+        // 轮子停过 先把currentTick_追到当前时间再计算deadline
+        currentTick_ = ticksAt(Timestamp::now());
+        ticking_ = true;
+        tickTimer_ = loop_->runEvery(tickSeconds_, std::bind(&TimingWheel::onTick, this));
+    }
+
+    // 多加一个tick 保证当前tick已经过去的部分不会让超时提前发生
+    entry->timeoutTicks_ = static_cast<int64_t>(ceil(timeout / tickSeconds_)) + 1;
+    entry->deadline_ = currentTick_ + entry->timeoutTicks_;
+    link(slotOf(entry->deadline_), entry);
+}
+
+void TimingWheel::cancel(Entry *entry)
+{
+    if (entry->wheel_ == this)
+    {
+        unlink(entry);
+        entry->wheel_ = nullptr;
+        --count_;
+    }
+}
+
+void TimingWheel::onTick()
+{
+    // tick定时器在loop线程中执行 直接用本轮poll返回时缓存的时间
+    int64_t target = ticksAt(loop_->pollReturnTime());
+    // loop被阻塞了很久 每个槽最多处理一次就够了
+    if (target - currentTick_ > numSlots_)
+    {
+        currentTick_ = target - numSlots_;
+    }
+    while (currentTick_ < target)
+    {
+        ++currentTick_;
+        expireSlot(currentTick_);
+    }
+
+    if (count_ == 0 && ticking_)
+    {
+        ticking_ = false;
+        loop_->cancel(tickTimer_);
+    }
+}
+
+void TimingWheel::expireSlot(int64_t tick)
+{
+    // 先把整个槽摘下来放到局部链表里，回调里面cancel/start其他entry都不会影响遍历
+    Entry *head = slotOf(tick);
+    if (head->next_ == head)
+    {
+        return;
+    }
+    Entry pending;
+    pending.prev_ = head->prev_;
+    pending.next_ = head->next_;
+    pending.prev_->next_ = &pending;
+    pending.next_->prev_ = &pending;
+    head->prev_ = head->next_ = head;
+
+    while (pending.next_ != &pending)
+    {
+        Entry *entry = pending.next_;
+        unlink(entry);
+        if (entry->deadline_ <= tick)
+        {
+            entry->wheel_ = nullptr;
+            --count_;
+            if (entry->callback_)
+            {
+                entry->callback_();
+            }
+        }
+        else
+        {
+            // refresh过 或者超时时间超过一圈 挂到deadline对应的槽里
+            link(slotOf(entry->deadline_), entry);
+        }
+    }
+}
+
+void TimingWheel::link(Entry *head, Entry *entry)
+{
+    entry->prev_ = head->prev_;
+    entry->next_ = head;
+    head->prev_->next_ = entry;
+    head->prev_ = entry;
+}
+
+void TimingWheel::unlink(Entry *entry)
+{
+    entry->prev_->next_ = entry->next_;
+    entry->next_->prev_ = entry->prev_;
+    entry->prev_ = entry->next_ = nullptr;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "noncopyable.h"
+#include "TimerId.h"
+#include "Timestamp.h"
+
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+class EventLoop;
+
+/**
+ * 每个EventLoop一个的hashed timing wheel 用来管理大量连接的空闲/读/写超时
+ *
+ * TimerQueue里每个定时器是std::set的一个节点，连接每收到一次数据就要把超时时间往后推，
+ * 等于每个字节都要做一次O(log n)的删除+插入还要new/delete。这里换成时间轮：
+ *  - Entry是侵入式的双向链表节点，直接嵌在TcpConnection里，挂到轮子上不需要分配内存
+ *  - refresh()只是把deadline_改成currentTick_ + timeoutTicks_，O(1)而且不移动节点，
+ *    等节点所在的槽被处理的时候发现还没到期，再把它挪到新的槽里(惰性重排)
+ *  - 轮子本身只用一个runEvery定时器驱动，没有Entry挂着的时候定时器会停掉
+ *
+ * 所有接口都只能在loop线程中调用
+*/
+class TimingWheel : noncopyable
+{
+public:
+    using Callback = std::function<void()>;
+
+    class Entry : noncopyable
+    {
+    public:
+        Entry();
+        ~Entry();
+
+        // 到期回调 只需要设置一次
+        void setCallback(Callback cb) {callback_ = std::move(cb);}
+        bool armed() const {return wheel_ != nullptr;}
+
+        // 把到期时间往后推一个完整的超时时间 没有挂在轮子上的时候什么都不做
+        inline void refresh();
+
+    private:
+        friend class TimingWheel;
+
+        TimingWheel *wheel_; // 挂在哪个轮子上 nullptr表示没有启动
+        Entry *prev_;
+        Entry *next_;
+        int64_t deadline_; // 到期的tick
+        int64_t timeoutTicks_;
+        Callback callback_;
+    };
+
+    static const int kDefaultNumSlots = 1024;
+
+    // tickSeconds是轮子的精度 超时实际发生在[timeout, timeout + tickSeconds]之间
+    explicit TimingWheel(EventLoop *loop,
+                        double tickSeconds = 0.1,
+                        int numSlots = kDefaultNumSlots);
+    ~TimingWheel();
+
+    // 启动或者重新启动entry timeout秒以后到期
+    void start(Entry *entry, double timeout);
+    // 取消entry 没有启动的entry也可以调用
+    void cancel(Entry *entry);
+
+    size_t size() const {return count_;}
+    double tickSeconds() const {return tickSeconds_;}
+
+private:
+    int64_t ticksAt(Timestamp time) const; // 计算time对应的tick数
+    void onTick();
+    void expireSlot(int64_t tick);
+
+    Entry* slotOf(int64_t tick) {return &slots_[static_cast<size_t>(tick % numSlots_)];}
+    static void link(Entry *head, Entry *entry);
+    static void unlink(Entry *entry);
+
+    EventLoop *loop_;
+    const double tickSeconds_;
+    const int64_t tickMicroSeconds_;
+    const int numSlots_;
+    const int64_t originMicroSeconds_; // tick 0对应的时间
+    std::vector<Entry> slots_; // 每个槽是一个带哨兵的环形双向链表
+
+    int64_t currentTick_; // 已经处理到的tick
+    size_t count_; // 挂在轮子上的entry个数
+    bool ticking_;
+    TimerId tickTimer_;
+};
+
+inline void TimingWheel::Entry::refresh()
+{
+    if (wheel_)
+    {
+        deadline_ = wheel_->currentTick_ + timeoutTicks_;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * 性能测试程序共用的小工具
+ * 每个测试结果输出成一行JSON 方便脚本收集和对比回归
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <string>
+
+inline int64_t benchNowNanos()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// {"bench":"queue","impl":"mpsc","producers":4,"ops_per_sec":1.2e+07}
+class BenchReport
+{
+public:
+    explicit BenchReport(const char *bench)
+    {
+        line_ = "{\"bench\":\"";
+        line_ += bench;
+        line_ += "\"";
+    }
+
+    BenchReport& add(const char *key, const char *value)
+    {
+        appendKey(key);
+        line_ += "\"";
+        line_ += value;
+        line_ += "\"";
+        return *this;
+    }
+
+    BenchReport& add(const char *key, const std::string &value) {return add(key, value.c_str());}
+
+    BenchReport& add(const char *key, int64_t value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof buf, "%lld", static_cast<long long>(value));
+        appendKey(key);
+        line_ += buf;
+        return *this;
+    }
+
+    BenchReport& add(const char *key, int value) {return add(key, static_cast<int64_t>(value));}
+    BenchReport& add(const char *key, size_t value) {return add(key, static_cast<int64_t>(value));}
+
+    BenchReport& add(const char *key, double value)
+    {
+        char buf[32];
+        snprintf(buf, sizeof buf, "%.6g", value);
+        appendKey(key);
+        line_ += buf;
+        return *this;
+    }
+
+    void print()
+    {
+        printf("%s}\n", line_.c_str());
+        fflush(stdout);
+    }
+
+private:
+    void appendKey(const char *key)
+    {
+        line_ += ",\"";
+        line_ += key;
+        line_ += "\":";
+    }
+
+    std::string line_;
+};
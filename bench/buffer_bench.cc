@@ -0,0 +1,298 @@
+/**
+ * Buffer的微基准测试 覆盖连接上最热的几条路径
+ *
+ *  mix     : 每轮append一条msg_size的消息，然后retrieve掉retrieve_pct%的可读数据，
+ *            模拟消息到达速度和解析速度不一致的输入缓冲区 连续模式和分块模式各测一遍
+ *            compactions是makeSpace把数据搬回头部的次数，moved_bytes是搬移的字节数，
+ *            resizes是makeSpace调用vector::resize扩容的次数(都是按append之前的状态推算出来的 只统计连续模式)
+ *  growth  : 从空Buffer开始按msg_size一直append到total_bytes再全部取走，
+ *            initial是构造时的初始大小 0表示第一次写入才分配
+ *  read_fd : 另一个线程往socketpair里写msg_size的消息，Buffer::readFd读出来再按消息retrieve，
+ *            reads/bytes_per_read/scratch_pct来自Buffer::readStats
+ *  write_fd: Buffer里攒好数据，Buffer::writeFd写进socketpair，另一个线程把对端读空
+ *
+ * 用法: buffer_bench [每个用例处理的总字节数]
+ * 结果每行一个JSON 以'{'开头的行是测试结果 其他行是库的日志
+*/
+#include "Buffer.h"
+#include "bench_util.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char* modeName(bool chunked)
+{
+    return chunked ? "chunked" : "contiguous";
+}
+
+// 按append之前的状态推算这次append会不会触发makeSpace 以及是搬移还是扩容
+struct SpaceCounter
+{
+    SpaceCounter() : compactions(0), movedBytes(0), resizes(0) {}
+
+    void beforeAppend(const Buffer &buf, size_t len)
+    {
+        if (buf.chunked() || buf.writableBytes() >= len)
+        {
+            return;
+        }
+        if (buf.writableBytes() + buf.prependableBytes() < len + Buffer::kCheapPrepend)
+        {
+            ++resizes;
+        }
+        else
+        {
+            ++compactions;
+            movedBytes += static_cast<int64_t>(buf.readableBytes());
+        }
+    }
+
+    int64_t compactions;
+    int64_t movedBytes;
+    int64_t resizes;
+};
+
+static void runMix(bool chunked, size_t msgSize, int retrievePct, size_t totalBytes)
+{
+    std::string msg(msgSize, 'x');
+    Buffer buf;
+    buf.setChunked(chunked);
+    SpaceCounter counter;
+    int64_t rounds = static_cast<int64_t>(std::max<size_t>(1, totalBytes / msgSize));
+    int64_t start = benchNowNanos();
+    for (int64_t i = 0; i < rounds; ++i)
+    {
+        counter.beforeAppend(buf, msgSize);
+        buf.append(msg.data(), msg.size());
+        // 每轮只取走一部分 剩下的越积越多，直到可读数据超过一条消息再整体取一次
+        size_t n = buf.readableBytes() * retrievePct / 100;
+        if (buf.readableBytes() > 64 * msgSize)
+        {
+            n = buf.readableBytes();
+        }
+        buf.retrieve(n);
+    }
+    int64_t elapsed = benchNowNanos() - start;
+    BenchReport("buffer")
+        .add("case", "mix")
+        .add("mode", modeName(chunked))
+        .add("msg_size", msgSize)
+        .add("retrieve_pct", retrievePct)
+        .add("ops", rounds)
+        .add("ns_per_op", static_cast<double>(elapsed) / rounds)
+        .add("gb_per_sec", static_cast<double>(rounds * msgSize) / elapsed)
+        .add("compactions", counter.compactions)
+        .add("moved_bytes", counter.movedBytes)
+        .add("resizes", counter.resizes)
+        .print();
+}
+
+static void runGrowth(size_t initialSize, size_t msgSize, size_t totalBytes)
+{
+    std::string msg(msgSize, 'x');
+    const int kRepeats = 16;
+    int64_t resizes = 0;
+    int64_t start = benchNowNanos();
+    for (int r = 0; r < kRepeats; ++r)
+    {
+        Buffer buf(initialSize);
+        SpaceCounter counter;
+        for (size_t n = 0; n < totalBytes; n += msgSize)
+        {
+            counter.beforeAppend(buf, msgSize);
+            buf.append(msg.data(), msg.size());
+        }
+        buf.retrieveAll();
+        resizes = counter.resizes;
+    }
+    int64_t elapsed = benchNowNanos() - start;
+    BenchReport("buffer")
+        .add("case", "growth")
+        .add("initial", initialSize)
+        .add("msg_size", msgSize)
+        .add("total_bytes", totalBytes)
+        .add("resizes", resizes)
+        .add("us_per_fill", elapsed / 1000.0 / kRepeats)
+        .add("gb_per_sec", static_cast<double>(totalBytes) * kRepeats / elapsed)
+        .print();
+}
+
+static void makeSocketPair(int sv[2])
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+}
+
+static void runReadFd(bool chunked, size_t msgSize, size_t totalBytes)
+{
+    int sv[2];
+    makeSocketPair(sv);
+    size_t messages = std::max<size_t>(1, totalBytes / msgSize);
+    std::thread writer([sv, msgSize, messages]() {
+        std::string msg(msgSize, 'x');
+        for (size_t i = 0; i < messages; ++i)
+        {
+            size_t off = 0;
+            while (off < msg.size())
+            {
+                ssize_t n = ::write(sv[1], msg.data() + off, msg.size() - off);
+                if (n <= 0)
+                {
+                    perror("write");
+                    exit(1);
+                }
+                off += n;
+            }
+        }
+    });
+
+    Buffer buf;
+    buf.setChunked(chunked);
+    size_t received = 0;
+    size_t expected = messages * msgSize;
+    int64_t start = benchNowNanos();
+    while (received < expected)
+    {
+        int savedErrno = 0;
+        ssize_t n = buf.readFd(sv[0], &savedErrno);
+        if (n <= 0)
+        {
+            fprintf(stderr, "readFd: %d\n", savedErrno);
+            exit(1);
+        }
+        received += n;
+        // 和TcpConnection的用法一样 凑够一条消息就取走一条
+        while (buf.readableBytes() >= msgSize)
+        {
+            buf.retrieve(msgSize);
+        }
+    }
+    int64_t elapsed = benchNowNanos() - start;
+    writer.join();
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    const Buffer::ReadStats &stats = buf.readStats();
+    BenchReport("buffer")
+        .add("case", "read_fd")
+        .add("mode", modeName(chunked))
+        .add("msg_size", msgSize)
+        .add("bytes", received)
+        .add("gb_per_sec", static_cast<double>(received) / elapsed)
+        .add("reads", stats.calls)
+        .add("bytes_per_read", stats.calls > 0 ? static_cast<double>(stats.bytes) / stats.calls : 0.0)
+        .add("scratch_pct", stats.bytes > 0 ? 100.0 * stats.scratchBytes / stats.bytes : 0.0)
+        .print();
+}
+
+static void runWriteFd(bool chunked, size_t msgSize, size_t totalBytes)
+{
+    int sv[2];
+    makeSocketPair(sv);
+    size_t messages = std::max<size_t>(1, totalBytes / msgSize);
+    size_t expected = messages * msgSize;
+    std::thread reader([sv, expected]() {
+        std::vector<char> sink(256 * 1024);
+        size_t got = 0;
+        while (got < expected)
+        {
+            ssize_t n = ::read(sv[1], sink.data(), sink.size());
+            if (n <= 0)
+            {
+                perror("read");
+                exit(1);
+            }
+            got += n;
+        }
+    });
+
+    // 每攒64条消息写一次 模拟输出缓冲区有积压的时候
+    std::string msg(msgSize, 'x');
+    const size_t kBatch = 64;
+    Buffer buf;
+    buf.setChunked(chunked);
+    int64_t writes = 0;
+    size_t appended = 0;
+    int64_t start = benchNowNanos();
+    while (appended < messages || buf.readableBytes() > 0)
+    {
+        for (size_t i = 0; i < kBatch && appended < messages; ++i, ++appended)
+        {
+            buf.append(msg.data(), msg.size());
+        }
+        int savedErrno = 0;
+        ssize_t n = buf.writeFd(sv[0], &savedErrno);
+        if (n < 0)
+        {
+            fprintf(stderr, "writeFd: %d\n", savedErrno);
+            exit(1);
+        }
+        ++writes;
+        buf.retrieve(n);
+    }
+    reader.join();
+    int64_t elapsed = benchNowNanos() - start;
+    ::close(sv[0]);
+    ::close(sv[1]);
+
+    BenchReport("buffer")
+        .add("case", "write_fd")
+        .add("mode", modeName(chunked))
+        .add("msg_size", msgSize)
+        .add("bytes", expected)
+        .add("gb_per_sec", static_cast<double>(expected) / elapsed)
+        .add("writes", writes)
+        .add("bytes_per_write", static_cast<double>(expected) / writes)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalBytes = argc > 1 ? static_cast<size_t>(atoll(argv[1])) : 256 * 1024 * 1024;
+    const size_t kMsgSizes[] = {16, 256, 4096, 65536};
+    const int kRetrievePcts[] = {0, 50, 100};
+    const bool kModes[] = {false, true};
+
+    for (bool chunked : kModes)
+    {
+        for (size_t msgSize : kMsgSizes)
+        {
+            for (int pct : kRetrievePcts)
+            {
+                runMix(chunked, msgSize, pct, totalBytes);
+            }
+        }
+    }
+
+    const size_t kInitialSizes[] = {0, Buffer::kInitialSize, 64 * 1024};
+    for (size_t initial : kInitialSizes)
+    {
+        for (size_t msgSize : kMsgSizes)
+        {
+            runGrowth(initial, msgSize, 4 * 1024 * 1024);
+        }
+    }
+
+    for (bool chunked : kModes)
+    {
+        for (size_t msgSize : kMsgSizes)
+        {
+            runReadFd(chunked, msgSize, totalBytes / 4);
+        }
+        for (size_t msgSize : kMsgSizes)
+        {
+            runWriteFd(chunked, msgSize, totalBytes / 4);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * Poller后端的对比测试 epoll水平触发/epoll边沿触发/poll/io_uring水平触发/io_uring边沿触发
+ *
+ * 每个用例建nfds对socketpair，读端全部注册到EventLoop上，每一轮往其中active%的写端各写1个字节，
+ * 读回调把字节读掉 一轮的事件全部处理完再开始下一轮，每轮活跃的fd依次轮换
+ *
+ *  events_per_sec     : 每秒分发的读事件
+ *  syscalls_per_event : poller自己的系统调用(每轮一次poll/epoll_wait/io_uring_enter 加上epoll_ctl)
+ *                       除以事件数 不包括测试本身的read/write
+ *  p50_us/p99_us      : 从write到读回调执行的延迟 同一轮先写的fd要等这一轮全部写完
+ *
+ * 100k对socketpair需要20万个fd 会先把RLIMIT_NOFILE调到硬上限，还不够就按上限缩小，实际个数见fds
+ * 内核不支持io_uring的时候EventLoop会退回epoll，io_uring的两组用例直接跳过 不会把epoll的结果记成io_uring
+ *
+ * 用法: poller_bench [每个用例最少的事件数]
+ * 结果每行一个JSON 以'{'开头的行是测试结果 其他行是库的日志
+*/
+#include "EventLoop.h"
+#include "Channel.h"
+#include "bench_util.h"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+struct Backend
+{
+    const char *name;
+    EventLoop::PollerType type;
+    bool edgeTriggered;
+};
+
+// 一个用例的状态 所有操作都在loop线程里
+class PollerCase
+{
+public:
+    PollerCase(EventLoop *loop, int nfds, int active, bool edgeTriggered, int64_t minEvents)
+        : loop_(loop)
+        , nfds_(nfds)
+        , active_(active)
+        , minEvents_(minEvents)
+        , writeFds_(nfds)
+        , writeTime_(nfds)
+        , next_(0)
+        , pending_(0)
+        , events_(0)
+        , rounds_(0)
+    {
+        for (int i = 0; i < nfds_; ++i)
+        {
+            int sv[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, sv) < 0)
+            {
+                perror("socketpair");
+                exit(1);
+            }
+            writeFds_[i] = sv[1];
+            Channel *channel = new Channel(loop_, sv[0]);
+            channel->setReadCallback(std::bind(&PollerCase::handleRead, this, i, sv[0]));
+            channel->setEdgeTriggered(edgeTriggered);
+            channel->enableReading();
+            channels_.emplace_back(channel);
+        }
+        latencies_.reserve(static_cast<size_t>(std::min<int64_t>(minEvents_ * 2, 4 << 20)));
+    }
+
+    ~PollerCase()
+    {
+        for (std::unique_ptr<Channel> &channel : channels_)
+        {
+            channel->disableAll();
+            channel->remove();
+            ::close(channel->fd());
+        }
+        for (int fd : writeFds_)
+        {
+            ::close(fd);
+        }
+    }
+
+    void startRound()
+    {
+        if (events_ >= minEvents_ && rounds_ >= 3)
+        {
+            loop_->quit();
+            return;
+        }
+        ++rounds_;
+        pending_ = active_;
+        char c = 'x';
+        for (int i = 0; i < active_; ++i)
+        {
+            int idx = next_;
+            next_ = next_ + 1 == nfds_ ? 0 : next_ + 1;
+            writeTime_[idx] = benchNowNanos();
+            if (::write(writeFds_[idx], &c, 1) != 1)
+            {
+                perror("write");
+                exit(1);
+            }
+        }
+    }
+
+    int64_t events() const {return events_;}
+    std::vector<int64_t>& latencies() {return latencies_;}
+
+private:
+    void handleRead(int idx, int fd)
+    {
+        char c;
+        if (::read(fd, &c, 1) == 1)
+        {
+            latencies_.push_back(benchNowNanos() - writeTime_[idx]);
+            ++events_;
+            if (--pending_ == 0)
+            {
+                // 这一轮全部到齐 下一轮放到本轮回调处理完以后
+                loop_->queueInLoop(std::bind(&PollerCase::startRound, this));
+            }
+        }
+    }
+
+    EventLoop *loop_;
+    const int nfds_;
+    const int active_;
+    const int64_t minEvents_;
+    std::vector<std::unique_ptr<Channel>> channels_;
+    std::vector<int> writeFds_;
+    std::vector<int64_t> writeTime_;
+    std::vector<int64_t> latencies_;
+    int next_;
+    int pending_;
+    int64_t events_;
+    int64_t rounds_;
+};
+
+static double percentileMicros(std::vector<int64_t> &samples, double p)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    size_t k = static_cast<size_t>(p * (samples.size() - 1));
+    std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k] / 1000.0;
+}
+
+static void runCase(const Backend &backend, int requestedFds, int nfds, int activePercent, int64_t minEvents)
+{
+    EventLoop loop(backend.type);
+    // io_uring不可用的时候EventLoop退回了epoll 和epoll的用例重复，不再测
+    if (loop.pollerType() != backend.type)
+    {
+        return;
+    }
+    if (backend.edgeTriggered && !loop.edgeTriggeredSupported())
+    {
+        return;
+    }
+    int active = std::max(1, nfds * activePercent / 100);
+    PollerCase c(&loop, nfds, active, backend.edgeTriggered, minEvents);
+
+    // 先空转一轮把注册提交掉 不算在测量里
+    loop.queueInLoop([&loop]() {loop.quit();});
+    loop.wakeup();
+    loop.loop();
+
+    EventLoop::InterestStats before = loop.interestStats();
+    int64_t iterationsBefore = loop.iteration();
+    int64_t start = benchNowNanos();
+    c.startRound();
+    loop.loop();
+    int64_t elapsed = benchNowNanos() - start;
+    EventLoop::InterestStats after = loop.interestStats();
+
+    int64_t events = c.events();
+    int64_t waits = loop.iteration() - iterationsBefore;
+    // 按实际的poller算: 只有epoll_ctl是单独的系统调用，
+    // io_uring的poll请求跟着io_uring_enter一起提交，poll的兴趣集合每次随poll传进内核
+    int64_t ctlSyscalls = loop.pollerType() == EventLoop::kEpoll ? after.ctlCalls - before.ctlCalls : 0;
+
+    BenchReport("poller")
+        .add("backend", backend.name)
+        .add("requested_fds", requestedFds)
+        .add("fds", nfds)
+        .add("active_pct", activePercent)
+        .add("events", events)
+        .add("events_per_sec", events * 1e9 / elapsed)
+        .add("waits", waits)
+        .add("ctl_calls", after.ctlCalls - before.ctlCalls)
+        .add("syscalls_per_event", static_cast<double>(waits + ctlSyscalls) / events)
+        .add("p50_us", percentileMicros(c.latencies(), 0.50))
+        .add("p99_us", percentileMicros(c.latencies(), 0.99))
+        .print();
+}
+
+// 每对socketpair两个fd 还要给EventLoop自己的eventfd/timerfd、标准输入输出留一些
+static int maxSocketPairs()
+{
+    struct rlimit rl;
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+        ::getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return static_cast<int>((std::min<rlim_t>(rl.rlim_cur, 1 << 30) - 64) / 2);
+}
+
+int main(int argc, char *argv[])
+{
+    int64_t minEvents = argc > 1 ? atoll(argv[1]) : 200000;
+    const Backend kBackends[] = {
+        {"epoll_lt", EventLoop::kEpoll, false},
+        {"epoll_et", EventLoop::kEpoll, true},
+        {"poll", EventLoop::kPoll, false},
+        {"io_uring_lt", EventLoop::kIoUring, false},
+        {"io_uring_et", EventLoop::kIoUring, true},
+    };
+    const int kFds[] = {10, 1000, 100000};
+    const int kActivePercents[] = {1, 10, 100};
+    const int limit = maxSocketPairs();
+
+    for (int requested : kFds)
+    {
+        int nfds = std::min(requested, limit);
+        for (int activePercent : kActivePercents)
+        {
+            for (const Backend &backend : kBackends)
+            {
+                runCase(backend, requested, nfds, activePercent, minEvents);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,187 @@
+/**
+ * EventLoop跨线程任务队列的竞争测试
+ *
+ *  mutex_vector : 原来的实现 每次post加锁emplace_back到vector 并且每次都写eventfd
+ *  mpsc         : MpscQueue 无锁push 只有队列从空变成非空的时候才写eventfd
+ *  eventloop    : 多个线程直接调用EventLoop::queueInLoop 端到端的吞吐
+ *
+ * 用法: queue_bench [每个生产者post的次数]
+ * 结果每行一个JSON 以'{'开头的行是测试结果 其他行是库的日志
+*/
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "MpscQueue.h"
+#include "bench_util.h"
+
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Functor = std::function<void()>;
+
+// 原来EventLoop::queueInLoop / doPendingFunctors的做法
+class MutexVectorQueue
+{
+public:
+    // 返回true表示需要唤醒消费者 原来的实现跨线程post每次都唤醒
+    bool post(Functor cb)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        pending_.emplace_back(std::move(cb));
+        return true;
+    }
+
+    size_t drain()
+    {
+        std::vector<Functor> functors;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            functors.swap(pending_);
+        }
+        for (const Functor &functor : functors)
+        {
+            functor();
+        }
+        return functors.size();
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Functor> pending_;
+};
+
+class LockFreeQueue
+{
+public:
+    bool post(Functor cb) {return queue_.push(std::move(cb));}
+
+    size_t drain()
+    {
+        return queue_.consumeAll([](Functor &functor) {functor();});
+    }
+
+private:
+    MpscQueue<Functor> queue_;
+};
+
+// 一个消费者线程阻塞在eventfd上 被唤醒以后drain队列
+template <typename Queue>
+void runQueue(const char *impl, int producers, int opsPerProducer)
+{
+    Queue queue;
+    int evfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    std::atomic<int64_t> wakeups(0);
+    int64_t executed = 0; // 只在消费者线程中修改
+    const int64_t total = static_cast<int64_t>(producers) * opsPerProducer;
+
+    std::thread consumer([&]() {
+        struct pollfd pfd;
+        pfd.fd = evfd;
+        pfd.events = POLLIN;
+        while (executed < total)
+        {
+            ::poll(&pfd, 1, 100);
+            uint64_t one;
+            ::read(evfd, &one, sizeof one);
+            queue.drain();
+        }
+    });
+
+    int64_t start = benchNowNanos();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < opsPerProducer; ++j)
+            {
+                if (queue.post([&executed]() {++executed;}))
+                {
+                    uint64_t one = 1;
+                    ::write(evfd, &one, sizeof one);
+                    wakeups.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    consumer.join();
+    int64_t elapsed = benchNowNanos() - start;
+    ::close(evfd);
+
+    BenchReport("queue")
+        .add("impl", impl)
+        .add("producers", producers)
+        .add("ops", total)
+        .add("ops_per_sec", total * 1e9 / elapsed)
+        .add("ns_per_op", static_cast<double>(elapsed) / total)
+        .add("wakeups_per_op", static_cast<double>(wakeups.load()) / total)
+        .print();
+}
+
+// 通过真正的EventLoop::queueInLoop post
+void runEventLoop(int producers, int opsPerProducer)
+{
+    EventLoopThread thread;
+    EventLoop *loop = thread.startLoop();
+    const int64_t total = static_cast<int64_t>(producers) * opsPerProducer;
+    int64_t executed = 0; // 只在loop线程中修改
+    std::atomic<bool> done(false);
+
+    int64_t start = benchNowNanos();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i)
+    {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < opsPerProducer; ++j)
+            {
+                loop->queueInLoop([&]() {
+                    if (++executed == total)
+                    {
+                        done.store(true, std::memory_order_release);
+                    }
+                });
+            }
+        });
+    }
+    for (std::thread &t : threads)
+    {
+        t.join();
+    }
+    while (!done.load(std::memory_order_acquire))
+    {
+        ::usleep(100);
+    }
+    int64_t elapsed = benchNowNanos() - start;
+
+    BenchReport("queue")
+        .add("impl", "eventloop")
+        .add("producers", producers)
+        .add("ops", total)
+        .add("ops_per_sec", total * 1e9 / elapsed)
+        .add("ns_per_op", static_cast<double>(elapsed) / total)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    int opsPerProducer = argc > 1 ? atoi(argv[1]) : 200000;
+    const int kProducers[] = {1, 2, 4, 8};
+
+    for (int producers : kProducers)
+    {
+        runQueue<MutexVectorQueue>("mutex_vector", producers, opsPerProducer);
+        runQueue<LockFreeQueue>("mpsc", producers, opsPerProducer);
+        runEventLoop(producers, opsPerProducer);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+/**
+ * Buffer分隔符查找的对比测试 naive(逐字节循环/std::search)和BufferSearch各级别实现
+ *
+ * 构造一段不含分隔符的随机文本，每隔line_len字节放一个分隔符，从头开始一个一个找完，
+ * 相当于按行解析line_len长的消息 line_len越长每次调用扫的字节越多，向量化的优势越明显
+ *
+ *  gb_per_sec : 每秒扫过的字节数(GB)
+ *  ns_per_find: 每找到一个分隔符的平均时间
+ *
+ * 另外用resume模式模拟一行分很多次收到：每次只多给16字节，从上次扫到的位置接着找，和每次从头扫对比
+ *
+ * 用法: search_bench [总字节数]
+*/
+#include "BufferSearch.h"
+#include "Buffer.h"
+#include "bench_util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// 编译器可能会把naive的循环自动向量化 用volatile的读挡住
+static const char* naiveFindByte(const char *begin, const char *end, char c)
+{
+    for (const char *p = begin; p < end; ++p)
+    {
+        if (*static_cast<const volatile char*>(p) == c)
+        {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+static const char* naiveFind(const char *begin, const char *end, const char *delim, size_t len)
+{
+    const char *p = std::search(begin, end, delim, delim + len);
+    return p == end ? nullptr : p;
+}
+
+struct Delimiter
+{
+    const char *name;
+    std::string bytes;
+};
+
+static std::string makeText(size_t total, size_t lineLen, const std::string &delim)
+{
+    std::string text;
+    text.reserve(total + lineLen);
+    unsigned seed = 1;
+    while (text.size() < total)
+    {
+        for (size_t i = 0; i + delim.size() < lineLen; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            text.push_back(static_cast<char>('a' + (seed >> 16) % 26)); // 小写字母 不会和分隔符冲突
+        }
+        text += delim;
+    }
+    return text;
+}
+
+template <typename Find>
+static void runScan(const char *impl, const Delimiter &delim, size_t lineLen, const std::string &text, Find find)
+{
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    int64_t finds = 0;
+    int64_t start = benchNowNanos();
+    for (const char *p = begin; p < end; )
+    {
+        const char *found = find(p, end);
+        if (found == nullptr)
+        {
+            break;
+        }
+        ++finds;
+        p = found + delim.bytes.size();
+    }
+    int64_t elapsed = benchNowNanos() - start;
+    BenchReport("search")
+        .add("mode", "scan")
+        .add("delim", delim.name)
+        .add("impl", impl)
+        .add("line_len", lineLen)
+        .add("finds", finds)
+        .add("gb_per_sec", static_cast<double>(text.size()) / elapsed)
+        .add("ns_per_find", finds > 0 ? static_cast<double>(elapsed) / finds : 0.0)
+        .print();
+}
+
+// 一行分成16字节一段慢慢到达 每到一段找一次分隔符
+static void runResume(bool resume, size_t lineLen, int lines)
+{
+    std::string line = makeText(lineLen, lineLen, "\r\n");
+    line.resize(lineLen);
+    const size_t kStep = 16;
+    int64_t scanned = 0;
+    int64_t start = benchNowNanos();
+    for (int i = 0; i < lines; ++i)
+    {
+        Buffer buf;
+        size_t from = 0;
+        for (size_t off = 0; off < line.size(); off += kStep)
+        {
+            buf.append(line.data() + off, std::min(kStep, line.size() - off));
+            size_t pos = buf.findCRLF(resume ? from : 0);
+            scanned += buf.readableBytes() - (resume ? from : 0);
+            if (pos != Buffer::npos)
+            {
+                break;
+            }
+            from = buf.resumeFrom(2); // '\r'可能是最后一个字节
+        }
+    }
+    int64_t elapsed = benchNowNanos() - start;
+    BenchReport("search")
+        .add("mode", resume ? "resume" : "rescan")
+        .add("delim", "crlf")
+        .add("impl", BufferSearch::levelName(BufferSearch::bestLevel()))
+        .add("line_len", lineLen)
+        .add("bytes_scanned", scanned)
+        .add("ns_per_line", static_cast<double>(elapsed) / lines)
+        .print();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t total = argc > 1 ? static_cast<size_t>(atoll(argv[1])) : 64 * 1024 * 1024;
+    const Delimiter kDelims[] = {
+        {"lf", "\n"},
+        {"crlf", "\r\n"},
+        {"crlfcrlf", "\r\n\r\n"},
+    };
+    const size_t kLineLens[] = {16, 64, 256, 4096, 65536};
+
+    std::vector<BufferSearch::Level> levels;
+    levels.push_back(BufferSearch::kScalar);
+#if defined(__x86_64__) || defined(__i386__)
+    levels.push_back(BufferSearch::kSse2);
+    if (BufferSearch::bestLevel() == BufferSearch::kAvx2)
+    {
+        levels.push_back(BufferSearch::kAvx2);
+    }
+#endif
+
+    for (const Delimiter &delim : kDelims)
+    {
+        for (size_t lineLen : kLineLens)
+        {
+            std::string text = makeText(total, lineLen, delim.bytes);
+            const char *d = delim.bytes.data();
+            const size_t len = delim.bytes.size();
+            if (len == 1)
+            {
+                runScan("naive", delim, lineLen, text, [d](const char *b, const char *e) {return naiveFindByte(b, e, d[0]);});
+            }
+            else
+            {
+                runScan("naive", delim, lineLen, text, [d, len](const char *b, const char *e) {return naiveFind(b, e, d, len);});
+            }
+            for (BufferSearch::Level level : levels)
+            {
+                runScan(BufferSearch::levelName(level), delim, lineLen, text,
+                        [d, len, level](const char *b, const char *e) {return BufferSearch::find(b, e, d, len, level);});
+            }
+        }
+    }
+
+    for (size_t lineLen : {256, 4096, 65536})
+    {
+        int lines = static_cast<int>(std::max<size_t>(1, (4 << 20) / lineLen));
+        runResume(false, lineLen, lines);
+        runResume(true, lineLen, lines);
+    }
+    return 0;
+}